@@ -1,49 +1,60 @@
-﻿#include "utility.h"
+﻿#define ALLOC_COUNTER_IMPLEMENTATION
+#include "alloc_counter.h"
+
+#include "utility.h"
+#include "benchmarks.h"
+#include "box.h"
 #include "bvh.h"
 #include "camera.h"
 #include "constant_medium.h"
+#include "flat_bvh.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "material.h"
+#include "mesh.h"
+#include "mesh_loader.h"
 #include "quad.h"
+#include "scene.h"
 #include "sphere.h"
 #include "texture.h"
 
-void cornell_box() {
-    hittable_list world;
-
-    auto red = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+//The empty box and its light, returns the white of the walls for the contents
+const material* cornell_box_walls(scene& objects, hittable_list& world, hittable_list& lights) {
+    auto red = objects.add_material<lambertian>(color(.65, .05, .05));
+    auto white = objects.add_material<lambertian>(color(.73, .73, .73));
+    auto green = objects.add_material<lambertian>(color(.12, .45, .15));
+    auto light = objects.add_material<diffuse_light>(color(15, 15, 15));
 
     // Cornell box sides
-    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 0, 555), vec3(0, 555, 0), green));
-    world.add(make_shared<quad>(point3(0, 0, 555), vec3(0, 0, -555), vec3(0, 555, 0), red));
-    world.add(make_shared<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 0, -555), white));
-    world.add(make_shared<quad>(point3(555, 0, 555), vec3(-555, 0, 0), vec3(0, 555, 0), white));
+    world.add(objects.make<quad>(point3(555, 0, 0), vec3(0, 0, 555), vec3(0, 555, 0), green));
+    world.add(objects.make<quad>(point3(0, 0, 555), vec3(0, 0, -555), vec3(0, 555, 0), red));
+    world.add(objects.make<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(objects.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 0, -555), white));
+    world.add(objects.make<quad>(point3(555, 0, 555), vec3(-555, 0, 0), vec3(0, 555, 0), white));
 
     // Light
-    world.add(make_shared<quad>(point3(213, 554, 227), vec3(130, 0, 0), vec3(0, 0, 105), light));
+    world.add(objects.make<quad>(point3(213, 554, 227), vec3(130, 0, 0), vec3(0, 0, 105), light));
+    lights.add(objects.make<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+
+    return white;
+}
+
+void cornell_box_scene(scene& objects, hittable_list& world, hittable_list& lights) {
+    auto white = cornell_box_walls(objects, world, lights);
 
     // Box
-    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
-    world.add(box1);
+    world.add(objects.make<oriented_box>(point3(0, 0, 0), point3(165, 330, 165), 15.0, vec3(265, 0, 295), white));
 
     // Glass Sphere
-    auto glass = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(190, 90, 190), 90, glass));
+    auto glass = objects.add_material<dielectric>(1.5);
+    world.add(objects.make<sphere>(point3(190, 90, 190), 90, glass));
 
-    // Light Sources
-    auto empty_material = shared_ptr<material>();
-    hittable_list lights;
-    lights.add(
-        make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), empty_material));
-    lights.add(make_shared<sphere>(point3(190, 90, 190), 90, empty_material));
+    // The sphere is only a sampling target
+    const material* empty_material = nullptr;
+    lights.add(objects.make<sphere>(point3(190, 90, 190), 90, empty_material));
+}
 
+camera cornell_box_camera() {
     camera cam;
 
     cam.aspect_ratio = 1.0;
@@ -59,11 +70,205 @@ void cornell_box() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world, lights);
+    return cam;
+}
+
+void cornell_box(integrator path_integrator = integrator::mixture) {
+    scene objects;
+    hittable_list world, lights;
+    cornell_box_scene(objects, world, lights);
+    objects.report_memory(std::clog);
+
+    camera cam = cornell_box_camera();
+    cam.path_integrator = path_integrator;
+    cam.render(flat_bvh(world), lights);
+}
+
+//The Cornell box holding a mesh (.obj or binary .ply) scaled to stand 330 high in its middle, a torus without a path
+void cornell_box_mesh(const std::string& path) {
+    scene objects;
+    hittable_list world, lights;
+    auto white = cornell_box_walls(objects, world, lights);
+
+    mesh_data buffers;
+    if (path.empty())
+        buffers = torus_mesh(200, 100, 100, 40);
+    else if (!load_mesh(path, buffers))
+        return;
+    auto mesh = objects.make<triangle_mesh>(std::move(buffers), white);
+
+    auto bounds = mesh->bounding_box();
+    auto extent = std::fmax(bounds.x.size(), std::fmax(bounds.y.size(), bounds.z.size()));
+    auto scale = extent > 0 ? 330 / extent : 1.0;
+    auto base = point3(bounds.x.min + bounds.x.max, 2 * bounds.y.min, bounds.z.min + bounds.z.max) / 2;
+    world.add(objects.make<transform>(mesh, affine::translation(point3(278, 0, 278) - scale * base) * affine::scaling(vec3(scale, scale, scale))));
+    objects.report_memory(std::clog);
+
+    camera cam = cornell_box_camera();
+    cam.path_integrator = integrator::nee_mis;
+    cam.render(flat_bvh(world), lights);
+}
+
+//Renders the Cornell box with each integrator for the same time and compares the noise left
+void compare_integrators(double seconds = 20) {
+    scene objects;
+    hittable_list world, lights;
+    cornell_box_scene(objects, world, lights);
+
+    camera cam = cornell_box_camera();
+    cam.image_width = 300;
+    cam.time_limit = seconds;
+    cam.adaptive_sampling = true; //Jittered samples, so a render cut short anywhere is unbiased
+    cam.target_error = 0;
+    cam.min_samples = cam.samples_per_pass = 4;
+    cam.max_samples = 1 << 20;
+
+    flat_bvh tree(world);
+    std::clog << "Equal-time integrator comparison, " << seconds << " s each\n";
+    render_stats stats[2];
+    const integrator integrators[2] = { integrator::mixture, integrator::nee_mis };
+    const char* names[2] = { "mixture", "nee_mis" };
+    for (int k = 0; k < 2; k++) {
+        cam.path_integrator = integrators[k];
+        cam.output_path = std::string("cornell_") + names[k] + ".ppm";
+        stats[k] = cam.render(tree, lights);
+    }
+
+    for (int k = 0; k < 2; k++) {
+        std::clog << names[k] << ": " << stats[k].samples_per_pixel << " spp in " << stats[k].seconds
+            << " s, relative error " << stats[k].relative_error << '\n';
+    }
+    //Error falls as 1 / sqrt(time), the squared ratio is the speedup to equal noise
+    auto ratio = stats[0].relative_error / stats[1].relative_error;
+    std::clog << "nee_mis error ratio " << ratio << ", " << ratio * ratio << "x as fast to equal noise\n";
 }
 
-int main() {
-    switch (1) {
+//Channel means of a render against a reference render of the same view, over the image and over
+//blocks of 8x8 pixels. Fails on a pixel that isn't finite or a mean outside the tolerance
+bool compare_renders(const std::string& path, const std::string& reference_path, double image_tolerance, double block_tolerance) {
+    accumulation_buffer test, reference;
+    if (!test.load(path) || !reference.load(reference_path))
+        return false;
+    if (test.width() != reference.width() || test.height() != reference.height()) {
+        std::cerr << "ERROR: '" << path << "' and '" << reference_path << "' have different resolutions.\n";
+        return false;
+    }
+
+    const int block = 8;
+    int blocks_x = (test.width() + block - 1) / block;
+    int blocks_y = (test.height() + block - 1) / block;
+    std::vector<color> test_blocks(size_t(blocks_x) * blocks_y), reference_blocks(test_blocks.size());
+    color test_sum(0, 0, 0), reference_sum(0, 0, 0);
+    int non_finite = 0;
+
+    for (int j = 0; j < test.height(); j++) {
+        for (int i = 0; i < test.width(); i++) {
+            auto pixel = test.mean(i, j);
+            if (!std::isfinite(pixel.x()) || !std::isfinite(pixel.y()) || !std::isfinite(pixel.z())) {
+                non_finite++;
+                continue;
+            }
+            auto b = size_t(j / block) * blocks_x + i / block;
+            test_blocks[b] += pixel;
+            reference_blocks[b] += reference.mean(i, j);
+            test_sum += pixel;
+            reference_sum += reference.mean(i, j);
+        }
+    }
+
+    //Largest relative difference over the channels, against the reference's brightest channel so dark channels don't dominate
+    auto difference = [](const color& a, const color& b) -> double {
+        auto scale = std::fmax(b.x(), std::fmax(b.y(), b.z()));
+        if (!(scale > 0))
+            return 0.0;
+        return std::fmax(std::fabs(a.x() - b.x()), std::fmax(std::fabs(a.y() - b.y()), std::fabs(a.z() - b.z()))) / scale;
+    };
+
+    auto image_difference = difference(test_sum, reference_sum);
+    double block_difference = 0;
+    for (size_t b = 0; b < test_blocks.size(); b++)
+        block_difference = std::fmax(block_difference, difference(test_blocks[b], reference_blocks[b]));
+
+    bool passed = non_finite == 0 && image_difference <= image_tolerance && block_difference <= block_tolerance;
+    std::clog << (passed ? "PASSED" : "FAILED") << " '" << path << "': " << non_finite << " non-finite pixels, image "
+        << 100 * image_difference << "% (" << 100 * image_tolerance << "% allowed), worst 8x8 block "
+        << 100 * block_difference << "% (" << 100 * block_tolerance << "% allowed)\n";
+    return passed;
+}
+
+/* Precision Check
+*
+* Renders a small Cornell box through bvh_node and flat_bvh at a fixed seed and saves each
+* render as a checkpoint named after prefix. Given the prefix of the same renders from the
+* other precision build (SRT_FLOAT_PRECISION), compares against them: the float and double
+* builds trace the same scene and have to agree up to noise, so flat quads culled by a
+* degenerate box or NaN samples show up as a failure. Returns whether every render passed.
+*/
+bool precision_check(const std::string& prefix, const std::string& reference_prefix) {
+    scene objects;
+    hittable_list world, lights;
+    cornell_box_scene(objects, world, lights);
+    bvh_node tree(world);
+    flat_bvh flat(world);
+
+    camera cam = cornell_box_camera();
+    cam.image_width = 64;
+    cam.samples_per_pixel = 256;
+    cam.seed = 1;
+
+    struct check {
+        const char* name;
+        const hittable* world;
+        integrator path_integrator;
+    };
+    const check checks[3] = {
+        { "bvh_node_mixture", &tree, integrator::mixture },
+        { "flat_bvh_mixture", &flat, integrator::mixture },
+        { "flat_bvh_nee_mis", &flat, integrator::nee_mis },
+    };
+
+    bool passed = true;
+    for (const auto& c : checks) {
+        cam.path_integrator = c.path_integrator;
+        cam.checkpoint_path = prefix + "_" + c.name + ".ckpt";
+        cam.output_path = prefix + "_" + c.name + ".pfm";
+        cam.render(*c.world, lights);
+
+        if (!reference_prefix.empty())
+            passed &= compare_renders(cam.checkpoint_path, reference_prefix + "_" + c.name + ".ckpt", 0.01, 0.05);
+    }
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    //merge <output> <checkpoint>... : combines checkpoints rendered with different seeds
+    if (argc > 3 && std::string(argv[1]) == "merge")
+        return merge_checkpoints(std::vector<std::string>(argv + 3, argv + argc), argv[2]) ? 0 : 1;
+
+    //precision <prefix> [<reference prefix>] : renders the precision check, compared with the other build's renders when given
+    if (argc > 2 && std::string(argv[1]) == "precision")
+        return precision_check(argv[2], argc > 3 ? argv[3] : "") ? 0 : 1;
+
+    int selection = (argc > 1) ? std::atoi(argv[1]) : 1;
+
+    switch (selection) {
 		case 1: cornell_box(); break;
+		case 2: cornell_box(integrator::nee_mis); break;
+		case 3: cornell_box_mesh(argc > 2 ? argv[2] : ""); break;
+
+		//Benchmarks
+		case 100: benchmark_rng(); break;
+		case 101: benchmark_bvh_builders(); break;
+		case 102: benchmark_flat_bvh(); break;
+		case 103: benchmark_wide_bvh(); break;
+		case 104: benchmark_soa_bvh(); break;
+		case 105: benchmark_primitive_kernels(); break;
+		case 106: benchmark_vec3(); break;
+		case 107: benchmark_light_sampling(); break;
+		case 108: compare_integrators(); break;
+		case 109: benchmark_occlusion(); break;
+		case 110: benchmark_box_culling(); break;
+		case 111: benchmark_instancing(); break;
+		case 112: benchmark_mesh_loading(); break;
     }
 }
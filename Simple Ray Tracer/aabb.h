@@ -35,18 +35,18 @@ class aabb {
 
 			for (int axis = 0; axis < 3; axis++) {
 				const interval& ax = axis_interval(axis);
-				const double adinv = 1.0 / ray_dir[axis];
+				const real adinv = 1 / ray_dir[axis];
 
 				auto t0 = (ax.min - ray_orig[axis]) * adinv;
 				auto t1 = (ax.max - ray_orig[axis]) * adinv;
 
 				if (t0 < t1) {
 					if (t0 > ray_t.min) ray_t.min = t0;
-					if (t1 < ray_t.max) ray_t.max = t1;
+					if (t1 * far_scale < ray_t.max) ray_t.max = t1 * far_scale;
 				}
 				else {
 					if (t1 > ray_t.min) ray_t.min = t1;
-					if (t0 < ray_t.max) ray_t.max = t0;
+					if (t0 * far_scale < ray_t.max) ray_t.max = t0 * far_scale;
 				}
 
 				if (ray_t.max <= ray_t.min)
@@ -62,14 +62,40 @@ class aabb {
 				return y.size() > z.size() ? 1 : 2;
 		}
 
+		//Empty boxes have negative extents and contribute no area
+		real surface_area() const {
+			auto dx = std::fmax(real(0), x.size());
+			auto dy = std::fmax(real(0), y.size());
+			auto dz = std::fmax(real(0), z.size());
+			return 2 * (dx * dy + dy * dz + dz * dx);
+		}
+
+		point3 centroid() const {
+			return point3((x.min + x.max) / 2, (y.min + y.max) / 2, (z.min + z.max) / 2);
+		}
+
 		static const aabb empty, universe;
 
 	private:
+		//The slab distances carry a few roundings in real, 1 + 2 * gamma(3) on the far one keeps hit() conservative
+		static constexpr real unit_roundoff = std::numeric_limits<real>::epsilon() / 2;
+		static constexpr real far_scale = 1 + 2 * (3 * unit_roundoff) / (1 - 3 * unit_roundoff);
+
 		void pad_to_minimums() {
-			double delta = 0.00001;
-			if (x.size() < delta) x = x.expand(delta);
-			if (y.size() < delta) y = y.expand(delta);
-			if (z.size() < delta) z = z.expand(delta);
+			pad_axis(x);
+			pad_axis(y);
+			pad_axis(z);
+		}
+
+		//A flat axis grows to 1e-5 or a few ulps of its coordinates, whichever is larger, so the
+		//pad survives rounding (1e-5 is below one float ulp at 554) and slab tests can hit it
+		static void pad_axis(interval& ax) {
+			if (!(ax.min <= ax.max))
+				return; //Empty
+			auto magnitude = std::fmax(std::fabs(ax.min), std::fabs(ax.max));
+			auto delta = std::fmax(real(0.00001), 8 * std::numeric_limits<real>::epsilon() * magnitude);
+			if (ax.size() < delta)
+				ax = ax.expand(delta);
 		}
 };
 
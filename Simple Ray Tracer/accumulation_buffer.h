@@ -0,0 +1,314 @@
+#ifndef ACCUMULATION_BUFFER_H
+#define ACCUMULATION_BUFFER_H
+
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <vector>
+
+//Welford's running mean and variance of one pixel's sample luminance within a pass
+struct luminance_stats {
+	std::uint32_t count = 0;
+	double mean = 0;
+	double m2 = 0; //Sum of squared deviations from the mean
+
+	void add(double x) {
+		count++;
+		auto delta = x - mean;
+		mean += delta / count;
+		m2 += delta * (x - mean);
+	}
+};
+
+/* Accumulation Buffer
+*
+* Running per-pixel radiance sums, sample counts and the luminance variance (as M2, the
+* sum of squared deviations). Progressive passes add into it, resolve() divides sums by
+* counts, and the whole state round-trips through a compact checkpoint file (20 bytes
+* per pixel) so a render can resume or be merged with checkpoints rendered from other
+* seeds. Variances of two sample sets combine with Chan's parallel update, which holds
+* only for independent samples: merging refuses a seed already in the buffer (the same
+* samples again) and a different sample_grid (strata that don't line up).
+*
+* Checkpoint layout, host byte order (checked on load):
+*   char[8]  "SRTACC02"
+*   uint32   0x01020304 byte-order mark
+*   uint32   width, height
+*   uint64   seed
+*   uint32   sample_grid
+*   per pixel: float sum_r, sum_g, sum_b, uint32 count, float m2
+*/
+class accumulation_buffer {
+	public:
+		//How the contents were produced, a resumed render must match them
+		std::uint64_t seed = 0;
+		int sample_grid = 0; //sqrt of the target samples per pixel, fixes the stratum of every sample index. 0 -> jittered
+
+		accumulation_buffer() {}
+		accumulation_buffer(int width, int height)
+			: image_width(width), image_height(height), sums(size_t(width) * height * 3, 0.0f), counts(size_t(width) * height, 0),
+			  m2s(size_t(width) * height, 0.0f) {}
+
+		int width() const { return image_width; }
+		int height() const { return image_height; }
+
+		//Each pixel is owned by one tile per pass, so calls never race on an element
+		void add(int i, int j, const color& sum, const luminance_stats& stats) {
+			combine(size_t(j) * image_width + i, sum.x(), sum.y(), sum.z(), stats.count, stats.m2);
+		}
+
+		std::uint32_t count(int i, int j) const { return counts[size_t(j) * image_width + i]; }
+
+		std::uint64_t total_samples() const {
+			std::uint64_t total = 0;
+			for (auto n : counts)
+				total += n;
+			return total;
+		}
+
+		//Standard error of the mean luminance relative to the mean, floored so black pixels converge
+		double relative_error(int i, int j) const {
+			auto pixel = size_t(j) * image_width + i;
+			auto n = counts[pixel];
+			if (n < 2)
+				return infinity;
+
+			auto variance = m2s[pixel] / (n - 1.0);
+			auto standard_error = std::sqrt(variance / n);
+			return standard_error / std::max(mean_luminance(pixel), 1e-3);
+		}
+
+		//RMS standard error of the pixel luminances relative to the mean image luminance, one noise figure per image
+		double image_relative_error() const {
+			double variance_sum = 0, luminance_sum = 0;
+			size_t pixels = 0;
+			for (size_t pixel = 0; pixel < counts.size(); pixel++) {
+				auto n = counts[pixel];
+				if (n < 2)
+					continue;
+				variance_sum += m2s[pixel] / (n - 1.0) / n;
+				luminance_sum += mean_luminance(pixel);
+				pixels++;
+			}
+			if (pixels == 0 || !(luminance_sum > 0))
+				return infinity;
+			return std::sqrt(variance_sum / pixels) / (luminance_sum / pixels);
+		}
+
+		color mean(int i, int j) const {
+			auto pixel = size_t(j) * image_width + i;
+			if (counts[pixel] == 0)
+				return color(0, 0, 0);
+			auto scale = 1.0 / counts[pixel];
+			return scale * color(sums[pixel * 3], sums[pixel * 3 + 1], sums[pixel * 3 + 2]);
+		}
+
+		void resolve(framebuffer& image) const {
+			for (int j = 0; j < image_height; j++)
+				for (int i = 0; i < image_width; i++)
+					image.set(i, j, mean(i, j));
+		}
+
+		//Why other can't be merged into this buffer, nullptr if it can
+		const char* merge_conflict(const accumulation_buffer& other) const {
+			if (other.image_width != image_width || other.image_height != image_height)
+				return "has a different resolution";
+			if (other.sample_grid != sample_grid)
+				return "was sampled on a different grid";
+			if (contains_seed(other.seed))
+				return "repeats a seed that is already merged";
+			for (auto s : other.merged_seeds)
+				if (contains_seed(s))
+					return "repeats a seed that is already merged";
+			return nullptr;
+		}
+
+		//Sums samples from another render of the same view with a different seed
+		bool merge(const accumulation_buffer& other) {
+			if (merge_conflict(other))
+				return false;
+
+			merged_seeds.push_back(other.seed);
+			merged_seeds.insert(merged_seeds.end(), other.merged_seeds.begin(), other.merged_seeds.end());
+			for (size_t pixel = 0; pixel < counts.size(); pixel++) {
+				combine(pixel, other.sums[pixel * 3], other.sums[pixel * 3 + 1], other.sums[pixel * 3 + 2],
+					other.counts[pixel], other.m2s[pixel]);
+			}
+			return true;
+		}
+
+		//Writes to a temporary file first so a crash mid-write never clobbers the previous checkpoint
+		bool save(const std::string& path) const {
+			auto temp_path = path + ".tmp";
+			{
+				std::ofstream file(temp_path, std::ios::binary);
+				if (!file)
+					return false;
+
+				file.write(magic, 8);
+				write_value(file, byte_order_mark);
+				write_value(file, std::uint32_t(image_width));
+				write_value(file, std::uint32_t(image_height));
+				write_value(file, seed);
+				write_value(file, std::uint32_t(sample_grid));
+
+				std::vector<unsigned char> records(counts.size() * record_size);
+				for (size_t pixel = 0; pixel < counts.size(); pixel++) {
+					std::memcpy(&records[pixel * record_size], &sums[pixel * 3], 3 * sizeof(float));
+					std::memcpy(&records[pixel * record_size + 12], &counts[pixel], sizeof(std::uint32_t));
+					std::memcpy(&records[pixel * record_size + 16], &m2s[pixel], sizeof(float));
+				}
+				file.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size()));
+
+				if (!file)
+					return false;
+			}
+
+			//Replaces path in one step (rename() on POSIX, MoveFileEx with MOVEFILE_REPLACE_EXISTING on Windows),
+			//so there is never a moment without a checkpoint on disk
+			std::error_code error;
+			std::filesystem::rename(temp_path, path, error);
+			return !error;
+		}
+
+		bool load(const std::string& path) {
+			std::ifstream file(path, std::ios::binary);
+			if (!file)
+				return false;
+
+			char header[8];
+			std::uint32_t bom, width, height, grid;
+			std::uint64_t file_seed;
+			file.read(header, 8);
+			read_value(file, bom);
+			read_value(file, width);
+			read_value(file, height);
+			read_value(file, file_seed);
+			read_value(file, grid);
+
+			if (!file || std::memcmp(header, magic, 8) != 0 || bom != byte_order_mark) {
+				std::cerr << "ERROR: '" << path << "' is not a checkpoint written on this platform.\n";
+				return false;
+			}
+
+			//The header's size has to account for exactly the rest of the file before anything is allocated
+			auto payload_start = file.tellg();
+			file.seekg(0, std::ios::end);
+			auto payload = std::uint64_t(file.tellg() - payload_start);
+			file.seekg(payload_start);
+			if (width > std::uint32_t(std::numeric_limits<int>::max()) || height > std::uint32_t(std::numeric_limits<int>::max())
+				|| payload != std::uint64_t(width) * height * record_size) {
+				std::cerr << "ERROR: Checkpoint '" << path << "' is truncated or its " << width << "x" << height << " header is corrupt.\n";
+				return false;
+			}
+
+			std::vector<unsigned char> records(static_cast<size_t>(payload));
+			file.read(reinterpret_cast<char*>(records.data()), std::streamsize(records.size()));
+			if (!file) {
+				std::cerr << "ERROR: Checkpoint '" << path << "' could not be read.\n";
+				return false;
+			}
+
+			*this = accumulation_buffer(int(width), int(height));
+			seed = file_seed;
+			sample_grid = int(grid);
+			for (size_t pixel = 0; pixel < counts.size(); pixel++) {
+				std::memcpy(&sums[pixel * 3], &records[pixel * record_size], 3 * sizeof(float));
+				std::memcpy(&counts[pixel], &records[pixel * record_size + 12], sizeof(std::uint32_t));
+				std::memcpy(&m2s[pixel], &records[pixel * record_size + 16], sizeof(float));
+			}
+			return true;
+		}
+
+	private:
+		static constexpr const char* magic = "SRTACC02";
+		static constexpr std::uint32_t byte_order_mark = 0x01020304;
+		static constexpr size_t record_size = 20;
+
+		int image_width = 0;
+		int image_height = 0;
+		std::vector<float> sums;
+		std::vector<std::uint32_t> counts;
+		std::vector<float> m2s;
+		std::vector<std::uint64_t> merged_seeds; //Of the buffers merged into this one, besides seed
+
+		bool contains_seed(std::uint64_t s) const {
+			return s == seed || std::find(merged_seeds.begin(), merged_seeds.end(), s) != merged_seeds.end();
+		}
+
+		double mean_luminance(size_t pixel) const {
+			if (counts[pixel] == 0)
+				return 0;
+			return luminance(color(sums[pixel * 3], sums[pixel * 3 + 1], sums[pixel * 3 + 2])) / counts[pixel];
+		}
+
+		//Adds n samples with radiance sum (r, g, b) and luminance M2, Chan et al.'s update for the combined M2
+		void combine(size_t pixel, double r, double g, double b, std::uint32_t n, double m2) {
+			if (n == 0)
+				return;
+
+			auto n_a = double(counts[pixel]);
+			auto delta = luminance(color(r, g, b)) / n - mean_luminance(pixel);
+
+			sums[pixel * 3 + 0] += float(r);
+			sums[pixel * 3 + 1] += float(g);
+			sums[pixel * 3 + 2] += float(b);
+			counts[pixel] += n;
+			m2s[pixel] += float(m2 + delta * delta * n_a * n / (n_a + n));
+		}
+
+		template <typename T>
+		static void write_value(std::ofstream& file, const T& value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template <typename T>
+		static void read_value(std::ifstream& file, T& value) {
+			file.read(reinterpret_cast<char*>(&value), sizeof(T));
+		}
+};
+
+//Sums checkpoints of the same image (typically rendered with different seeds) and writes the result
+inline bool merge_checkpoints(const std::vector<std::string>& paths, const std::string& output_path,
+	image_format format = image_format::automatic) {
+	accumulation_buffer merged;
+
+	for (const auto& path : paths) {
+		accumulation_buffer part;
+		if (!part.load(path))
+			return false;
+
+		if (merged.width() == 0) {
+			merged = part;
+		}
+		else if (auto conflict = merged.merge_conflict(part)) {
+			std::cerr << "ERROR: Checkpoint '" << path << "' " << conflict << ".\n";
+			return false;
+		}
+		else {
+			merged.merge(part);
+		}
+		auto spp = double(part.total_samples()) / (size_t(part.width()) * part.height());
+		std::clog << "Merged '" << path << "' (seed " << part.seed << ", " << spp << " spp)\n";
+	}
+
+	if (merged.width() == 0)
+		return false;
+
+	framebuffer image(merged.width(), merged.height());
+	merged.resolve(image);
+	return write_image(image, output_path, format);
+}
+
+#endif
\ No newline at end of file
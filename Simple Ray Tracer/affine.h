@@ -0,0 +1,135 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "vec3.h"
+
+#include <cmath>
+#include <limits>
+
+/* Affine Transform
+*
+* x' = A x + b stored as the 3x4 matrix [A | b], row major. Points take the
+* translation, directions don't, and normals go through the transpose of the inverse's
+* linear part. The factories build exact inverse pairs (a rotation by -angle stores
+* exactly the transpose of one by angle), inverse() handles any other matrix through
+* the adjugate.
+*/
+class affine {
+	public:
+		real m[3][4];
+
+		affine() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } {}
+
+		static affine translation(const vec3& offset) {
+			affine t;
+			for (int i = 0; i < 3; i++)
+				t.m[i][3] = offset[i];
+			return t;
+		}
+
+		static affine scaling(const vec3& factors) {
+			affine s;
+			for (int i = 0; i < 3; i++)
+				s.m[i][i] = factors[i];
+			return s;
+		}
+
+		//About the x (0), y (1) or z (2) axis by angle degrees, counterclockwise looking down the axis
+		static affine rotation(int axis, double angle) {
+			auto radians = degrees_to_radians(angle);
+			real sin_theta = std::sin(radians);
+			real cos_theta = std::cos(radians);
+
+			//The two other axes in cyclic order, y rotates z into x
+			int a = (axis + 1) % 3, b = (axis + 2) % 3;
+			affine r;
+			r.m[a][a] = cos_theta;
+			r.m[a][b] = -sin_theta;
+			r.m[b][a] = sin_theta;
+			r.m[b][b] = cos_theta;
+			return r;
+		}
+
+		point3 point(const point3& p) const {
+			return point3(
+				m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+				m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+				m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]
+			);
+		}
+
+		vec3 vector(const vec3& v) const {
+			return vec3(
+				m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+				m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+				m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z()
+			);
+		}
+
+		//A^T n, called on the inverse it maps normals into the transformed space
+		vec3 transposed_vector(const vec3& n) const {
+			return vec3(
+				m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+				m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+				m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z()
+			);
+		}
+
+		//(*this)(other(x)), other applies first
+		affine operator*(const affine& other) const {
+			affine c;
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 4; j++) {
+					real sum = j == 3 ? m[i][3] : 0;
+					for (int k = 0; k < 3; k++)
+						sum += m[i][k] * other.m[k][j];
+					c.m[i][j] = sum;
+				}
+			}
+			return c;
+		}
+
+		//A^-1 = adj(A) / det(A), b' = -A^-1 b. Singular matrices give infinities
+		affine inverse() const {
+			affine inv;
+			for (int i = 0; i < 3; i++) {
+				int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+				for (int j = 0; j < 3; j++) {
+					int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+					inv.m[j][i] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1]; //Cofactor, transposed
+				}
+			}
+
+			real det = m[0][0] * inv.m[0][0] + m[0][1] * inv.m[1][0] + m[0][2] * inv.m[2][0];
+			for (int i = 0; i < 3; i++)
+				for (int j = 0; j < 3; j++)
+					inv.m[i][j] /= det;
+
+			for (int i = 0; i < 3; i++)
+				inv.m[i][3] = -(inv.m[i][0] * m[0][3] + inv.m[i][1] * m[1][3] + inv.m[i][2] * m[2][3]);
+			return inv;
+		}
+
+		//max over rows of sum |A_ij|, how much the map can grow an error bound along any axis
+		real row_norm() const {
+			real norm = 0;
+			for (int i = 0; i < 3; i++)
+				norm = std::fmax(norm, std::fabs(m[i][0]) + std::fabs(m[i][1]) + std::fabs(m[i][2]));
+			return norm;
+		}
+
+		//Rotations and translations only: normals keep their length
+		bool is_rigid() const {
+			auto eps = 64 * std::numeric_limits<real>::epsilon();
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					real dot_ij = m[0][i] * m[0][j] + m[1][i] * m[1][j] + m[2][i] * m[2][j];
+					if (std::fabs(dot_ij - (i == j ? 1 : 0)) > eps)
+						return false;
+				}
+			}
+			return true;
+		}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/* Allocation Counter
+*
+* Counts global operator new calls per thread so a render can report heap
+* allocations per sample. Replacing operator new has to happen in exactly one
+* translation unit, so like stb_image the replacements are only compiled where
+* ALLOC_COUNTER_IMPLEMENTATION is defined before the include:
+*
+*   #define ALLOC_COUNTER_IMPLEMENTATION
+*   #include "alloc_counter.h"
+*
+* Without it the counter stays at zero and allocation_counting() is false.
+* Over-aligned (std::align_val_t) allocations keep the default operators and
+* are not counted.
+*/
+
+inline thread_local std::uint64_t thread_allocation_count = 0;
+inline bool allocation_counter_installed = false;
+
+inline bool allocation_counting() { return allocation_counter_installed; }
+
+#ifdef ALLOC_COUNTER_IMPLEMENTATION
+
+#include <cstdlib>
+#include <new>
+
+static const bool allocation_counter_registered = (allocation_counter_installed = true);
+
+//Out of line, so GCC never sees free() inlined against a pointer from operator new (-Wmismatched-new-delete)
+#if defined(__GNUC__) || defined(__clang__)
+#define ALLOC_COUNTER_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define ALLOC_COUNTER_NOINLINE __declspec(noinline)
+#else
+#define ALLOC_COUNTER_NOINLINE
+#endif
+
+//The default nothrow forms forward to these, the array and sized forms are replaced too so every pair matches
+void* operator new(std::size_t size) {
+	thread_allocation_count++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+ALLOC_COUNTER_NOINLINE void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	::operator delete(p);
+}
+
+void operator delete[](void* p) noexcept {
+	::operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	::operator delete(p);
+}
+
+#endif
+
+#endif
\ No newline at end of file
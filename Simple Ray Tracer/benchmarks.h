@@ -0,0 +1,829 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include "utility.h"
+#include "accumulation_buffer.h"
+#include "box.h"
+#include "bvh.h"
+#include "bvh_builder.h"
+#include "flat_bvh.h"
+#include "hittable_list.h"
+#include "light_sampler.h"
+#include "material.h"
+#include "mesh.h"
+#include "mesh_loader.h"
+#include "onb.h"
+#include "pdf.h"
+#include "primitive_soa.h"
+#include "quad.h"
+#include "soa_bvh.h"
+#include "sphere.h"
+#include "tile_scheduler.h"
+#include "tlas.h"
+#include "wide_bvh.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+//Wall-clock timer for the benchmarks below
+class stopwatch {
+	public:
+		stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+		double seconds() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point start;
+};
+
+//Grey diffuse material shared by the benchmark scenes
+const material* benchmark_white() {
+	static const lambertian white(color(.73, .73, .73));
+	return &white;
+}
+
+//Runs draw() count times on each of thread_count threads and reports draws per second
+template <typename Draw>
+double measure_draws(int thread_count, long long count, Draw draw) {
+	std::vector<double> sinks(thread_count);
+	std::vector<std::thread> workers;
+
+	stopwatch timer;
+	for (int id = 0; id < thread_count; id++) {
+		workers.emplace_back([&, id]() {
+			auto sum = 0.0;
+			for (long long i = 0; i < count; i++)
+				sum += draw();
+			sinks[id] = sum; //Keeps the loop from being optimised away
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	return thread_count * double(count) / timer.seconds();
+}
+
+//Compares std::rand against the per-thread xoshiro256** generator, on one thread and on all of them
+void benchmark_rng() {
+	const long long draws = 50'000'000;
+	int threads = resolve_thread_count(0);
+
+	auto std_rand = []() { return std::rand() / (RAND_MAX + 1.0); };
+	auto xoshiro = []() { return random_double(); };
+
+	std::vector<int> thread_counts = { 1 };
+	if (threads > 1)
+		thread_counts.push_back(threads);
+
+	for (int thread_count : thread_counts) {
+		auto rand_rate = measure_draws(thread_count, draws, std_rand);
+		auto xoshiro_rate = measure_draws(thread_count, draws, xoshiro);
+
+		std::clog << thread_count << " thread(s): std::rand " << rand_rate / 1e6 << " M/s, xoshiro256** "
+				  << xoshiro_rate / 1e6 << " M/s (" << xoshiro_rate / rand_rate << "x)\n";
+	}
+}
+
+//Many small spheres scattered between a few very large ones, which the median split handles poorly
+hittable_list mixed_size_spheres(int count) {
+	auto white = benchmark_white();
+
+	hittable_list objects;
+
+	thread_rng().reseed(7);
+	for (int i = 0; i < count; i++)
+		objects.add(make_shared<sphere>(point3::random(0, 1000), random_double(0.5, 4), white));
+
+	for (int i = 0; i < 8; i++)
+		objects.add(make_shared<sphere>(point3::random(0, 1000), random_double(150, 300), white));
+
+	return objects;
+}
+
+//Rays from random points on a sphere around the box towards random points inside it
+std::vector<ray> probe_rays(const aabb& bbox, int count) {
+	std::vector<ray> rays;
+	auto center = bbox.centroid();
+	auto radius = 0.5 * std::sqrt(bbox.x.size() * bbox.x.size() + bbox.y.size() * bbox.y.size() + bbox.z.size() * bbox.z.size());
+
+	thread_rng().reseed(11);
+	for (int i = 0; i < count; i++) {
+		auto origin = center + 2 * radius * random_unit_vector();
+		auto target = point3(random_double(bbox.x.min, bbox.x.max), random_double(bbox.y.min, bbox.y.max), random_double(bbox.z.min, bbox.z.max));
+		rays.push_back(ray(origin, target - origin));
+	}
+
+	return rays;
+}
+
+//Closest-hit queries per second on the calling thread
+double measure_rays(const hittable& world, const std::vector<ray>& rays, int repeats = 4) {
+	size_t hits = 0;
+	stopwatch timer;
+
+	for (int pass = 0; pass < repeats; pass++) {
+		for (const auto& r : rays) {
+			hit_record rec;
+			if (world.hit(r, interval(0.001, infinity), rec))
+				hits++;
+		}
+	}
+
+	auto seconds = timer.seconds();
+	std::clog << "    (" << hits / repeats << " hits) ";
+	return repeats * double(rays.size()) / seconds;
+}
+
+//Any-hit queries per second on the calling thread
+double measure_occlusion(const hittable& world, const std::vector<ray>& rays, int repeats = 4) {
+	size_t blocked = 0;
+	stopwatch timer;
+
+	for (int pass = 0; pass < repeats; pass++)
+		for (const auto& r : rays)
+			blocked += world.occluded(r, interval(0.001, infinity));
+
+	auto seconds = timer.seconds();
+	std::clog << "    (" << blocked / repeats << " blocked) ";
+	return repeats * double(rays.size()) / seconds;
+}
+
+//Builds the same scene with the median and SAH splits and compares tree cost and traversal speed
+void benchmark_bvh_builders() {
+	auto objects = mixed_size_spheres(100'000);
+	auto rays = probe_rays(objects.bounding_box(), 200'000);
+
+	for (auto split : { bvh_split::median, bvh_split::sah }) {
+		stopwatch build_timer;
+		bvh_node tree(objects, split);
+		auto build_seconds = build_timer.seconds();
+
+		std::clog << (split == bvh_split::median ? "median" : "sah   ") << ": build " << build_seconds << " s, SAH cost " << tree.sah_cost();
+		auto rate = measure_rays(tree, rays);
+		std::clog << rate / 1e6 << " Mrays/s\n";
+	}
+
+	//The parallel builder on one thread and on all of them, against the constructor on a scene ten times larger
+	auto large = mixed_size_spheres(1'000'000);
+	stopwatch serial_timer;
+	bvh_node serial(large);
+	auto serial_seconds = serial_timer.seconds();
+	std::clog << "1M spheres, constructor: build " << serial_seconds << " s, SAH cost " << serial.sah_cost() << "\n";
+
+	for (int threads : { 1, 0 }) {
+		bvh_builder builder;
+		builder.thread_count = threads;
+		auto tree = builder.build(large);
+		std::clog << "1M spheres, bvh_builder (" << builder.threads() << " threads): build " << builder.seconds() << " s ("
+				  << serial_seconds / builder.seconds() << "x), SAH cost " << tree->sah_cost() << "\n";
+	}
+}
+
+//Traces the same rays through the pointer-based bvh_node and its flattened form
+void benchmark_flat_bvh() {
+	auto objects = mixed_size_spheres(100'000);
+	auto rays = probe_rays(objects.bounding_box(), 200'000);
+
+	bvh_node tree(objects);
+	stopwatch flatten_timer;
+	flat_bvh flat(tree);
+	auto flatten_seconds = flatten_timer.seconds();
+
+	std::clog << "bvh_node:";
+	auto tree_rate = measure_rays(tree, rays);
+	std::clog << tree_rate / 1e6 << " Mrays/s\n";
+
+	std::clog << "flat_bvh: " << flat.node_count() << " nodes (" << flat.node_count() * sizeof(flat_bvh_node) / 1024
+			  << " KiB), flattened in " << flatten_seconds << " s";
+	auto flat_rate = measure_rays(flat, rays);
+	std::clog << flat_rate / 1e6 << " Mrays/s (" << flat_rate / tree_rate << "x)\n";
+}
+
+//Binary bvh_node against BVH4/BVH8 with every slab kernel the CPU supports
+void benchmark_wide_bvh() {
+	auto objects = mixed_size_spheres(100'000);
+	auto rays = probe_rays(objects.bounding_box(), 200'000);
+
+	bvh_node tree(objects);
+	std::clog << "bvh_node:           ";
+	auto tree_rate = measure_rays(tree, rays);
+	std::clog << tree_rate / 1e6 << " Mrays/s\n";
+
+	auto report = [&](const char* name, const hittable& world, simd_isa isa) {
+		std::clog << name << " (" << simd_isa_name(isa) << "):";
+		auto rate = measure_rays(world, rays);
+		std::clog << rate / 1e6 << " Mrays/s (" << rate / tree_rate << "x)\n";
+	};
+
+	for (auto isa : { simd_isa::scalar, simd_isa::sse, simd_isa::avx2 }) {
+		if (supported_simd_isa(isa) != isa)
+			continue;
+
+		bvh4 wide4(tree, isa);
+		report("bvh4", wide4, wide4.kernel_isa());
+
+		bvh8 wide8(tree, isa);
+		report("bvh8", wide8, wide8.kernel_isa());
+	}
+}
+
+//flat_bvh (virtual call per primitive) against soa_bvh (per-type runs) at a few leaf sizes
+void benchmark_soa_bvh() {
+	auto objects = mixed_size_spheres(100'000);
+	auto rays = probe_rays(objects.bounding_box(), 200'000);
+
+	bvh_node tree(objects);
+	flat_bvh flat(tree);
+	std::clog << "flat_bvh:       ";
+	auto flat_rate = measure_rays(flat, rays);
+	std::clog << flat_rate / 1e6 << " Mrays/s\n";
+
+	for (int leaf_size : { 1, 2, 4, 8 }) {
+		soa_bvh soa(tree, leaf_size);
+		std::clog << "soa_bvh (leaf " << leaf_size << "): " << soa.node_count() << " nodes, " << soa.run_count() << " runs";
+		auto rate = measure_rays(soa, rays);
+		std::clog << rate / 1e6 << " Mrays/s (" << rate / flat_rate << "x)\n";
+	}
+}
+
+//Ray-primitive tests per second for each distance kernel and run length, against virtual hit() calls
+void benchmark_primitive_kernels() {
+	auto white = benchmark_white();
+	const int ray_count = 200'000;
+	const int repeats = 8;
+
+	//A cluster of overlapping spheres and quads inside [0, 10]^3
+	thread_rng().reseed(13);
+	hittable_list sphere_list, quad_list;
+	for (std::uint32_t i = 0; i < max_primitive_run; i++) {
+		sphere_list.add(make_shared<sphere>(point3::random(2, 8), random_double(0.5, 2), white));
+		quad_list.add(make_shared<quad>(point3::random(1, 6), vec3::random(0, 4), vec3::random(0, 4), white));
+	}
+	auto rays = probe_rays(aabb(point3(0, 0, 0), point3(10, 10, 10)), ray_count);
+
+	auto report = [&](const char* name, std::uint32_t count, auto intersect) {
+		size_t hits = 0;
+		stopwatch timer;
+		for (int pass = 0; pass < repeats; pass++)
+			for (const auto& r : rays)
+				hits += intersect(r, count);
+		auto rate = repeats * double(rays.size()) * count / timer.seconds();
+		std::clog << "  " << name << " x" << count << ": " << rate / 1e6 << " M tests/s (" << hits / repeats << " hits)\n";
+	};
+
+	auto virtual_hits = [](const hittable_list& list) {
+		return [&list](const ray& r, std::uint32_t count) {
+			hit_record rec;
+			interval ray_t(0.001, infinity);
+			bool hit_anything = false;
+			for (std::uint32_t i = 0; i < count; i++) {
+				if (list.objects[i]->hit(r, ray_t, rec)) {
+					hit_anything = true;
+					ray_t.max = rec.s;
+				}
+			}
+			return hit_anything;
+		};
+	};
+
+	auto nearest_hits = [](const auto& soa) {
+		return [&soa](const ray& r, std::uint32_t count) {
+			real t;
+			return soa.nearest(r, 0, count, interval(0.001, infinity), t) != count;
+		};
+	};
+
+	for (auto kind : { primitive_type::sphere, primitive_type::quad }) {
+		const auto& list = kind == primitive_type::sphere ? sphere_list : quad_list;
+		std::clog << (kind == primitive_type::sphere ? "spheres" : "quads") << ":\n";
+
+		for (std::uint32_t count : { 4u, 8u, 16u })
+			report("virtual", count, virtual_hits(list));
+
+		for (auto isa : { simd_isa::scalar, simd_isa::sse, simd_isa::avx2 }) {
+			sphere_soa spheres(isa);
+			quad_soa quads(isa);
+			if (spheres.kernel_isa() != isa) //Not supported by the CPU or this build
+				continue;
+
+			for (const auto& object : list.objects) {
+				if (kind == primitive_type::sphere)
+					spheres.add(static_cast<const sphere&>(*object));
+				else
+					quads.add(static_cast<const quad&>(*object));
+			}
+
+			for (std::uint32_t count : { 4u, 8u, 16u }) {
+				if (kind == primitive_type::sphere)
+					report(simd_isa_name(isa), count, nearest_hits(spheres));
+				else
+					report(simd_isa_name(isa), count, nearest_hits(quads));
+			}
+		}
+	}
+}
+
+//vec3 operations per second and end-to-end BVH rays per second, to compare builds with and without SRT_SIMD_VEC3
+void benchmark_vec3() {
+	const int n = 4096; //Operands cycle through arrays that stay in L1/L2
+	const long long count = 20'000'000;
+
+#if SRT_VEC3_LANES == 4 && defined(SRT_FLOAT_PRECISION)
+	const char* mode = "simd (sse)";
+#elif SRT_VEC3_LANES == 4 && defined(__AVX2__)
+	const char* mode = "simd (avx2)";
+#elif SRT_VEC3_LANES == 4
+	const char* mode = "simd (sse2)";
+#else
+	const char* mode = "scalar";
+#endif
+	std::clog << "vec3: " << mode << ", " << (sizeof(real) == 4 ? "float" : "double") << ", " << sizeof(vec3) << " B\n";
+
+	thread_rng().reseed(17);
+	std::vector<vec3> a(n), b(n);
+	std::vector<real> scale(n);
+	std::vector<onb> frames;
+	std::vector<aabb> boxes;
+	std::vector<ray> rays;
+	for (int i = 0; i < n; i++) {
+		a[i] = vec3::random(-1, 1);
+		b[i] = random_unit_vector();
+		scale[i] = real(random_double(0.5, 2));
+		frames.emplace_back(b[i]);
+		boxes.emplace_back(point3::random(-1, 0), point3::random(0, 1));
+		rays.emplace_back(point3::random(-2, 2), vec3::random(-1, 1));
+	}
+
+	auto report = [&](const char* name, auto op) {
+		int i = 0;
+		auto rate = measure_draws(1, count, [&]() {
+			i = (i + 1) & (n - 1);
+			return double(op(i));
+		});
+		std::clog << "  " << name << ": " << rate / 1e6 << " M/s\n";
+	};
+	auto sum = [](const vec3& v) { return v.x() + v.y() + v.z(); };
+
+	report("dot        ", [&](int i) { return dot(a[i], b[i]); });
+	report("cross      ", [&](int i) { return sum(cross(a[i], b[i])); });
+	report("operator/  ", [&](int i) { return sum(a[i] / scale[i]); });
+	report("unit_vector", [&](int i) { return sum(unit_vector(a[i])); });
+	report("aabb::hit  ", [&](int i) { return boxes[i].hit(rays[i], interval(0, infinity)); });
+	report("onb        ", [&](int i) { return sum(frames[i].transform(a[i])); });
+	report("refract    ", [&](int i) { return sum(refract(unit_vector(a[i]), b[i], 1 / 1.5)); });
+
+	auto objects = mixed_size_spheres(100'000);
+	auto probes = probe_rays(objects.bounding_box(), 200'000);
+	flat_bvh world(objects);
+	std::clog << "flat_bvh:";
+	auto ray_rate = measure_rays(world, probes);
+	std::clog << ray_rate / 1e6 << " Mrays/s\n";
+}
+
+/* Many-Light Direct Lighting
+*
+* 400 emissive quads of random size and brightness over a floor. Direct light at random
+* floor points is estimated by picking a light, sampling a direction towards it and
+* dividing by the pdf, with the lights as a plain hittable_list (uniform choice, every
+* light's pdf evaluated) and as a light_sampler. Efficiency is 1 / (variance * time).
+*/
+void benchmark_light_sampling() {
+	const int light_count = 400;
+	const int point_count = 2000;
+	const int samples = 64;
+
+	static const lambertian floor_material(color(.73, .73, .73));
+	std::vector<std::unique_ptr<diffuse_light>> emitters;
+	hittable_list objects, lights;
+
+	thread_rng().reseed(19);
+	objects.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 0, 100), vec3(100, 0, 0), &floor_material));
+	for (int i = 0; i < light_count; i++) {
+		auto brightness = std::pow(10.0, random_double(0, 3));
+		emitters.push_back(std::make_unique<diffuse_light>(brightness * color(random_double(.5, 1), random_double(.5, 1), random_double(.5, 1))));
+		auto size = random_double(0.2, 3);
+		auto light = make_shared<quad>(point3(random_double(0, 97), random_double(10, 30), random_double(0, 97)),
+			vec3(size, 0, 0), vec3(0, 0, size), emitters.back().get()); //Facing down
+		objects.add(light);
+		lights.add(light);
+	}
+	bvh_node world(objects);
+
+	std::vector<point3> points;
+	for (int i = 0; i < point_count; i++)
+		points.push_back(point3(random_double(5, 95), 0, random_double(5, 95)));
+
+	auto estimate = [&](const hittable& light_set, const char* name) {
+		double variance_sum = 0, mean_sum = 0;
+		stopwatch timer;
+		for (const auto& p : points) {
+			luminance_stats stats;
+			for (int s = 0; s < samples; s++) {
+				hittable_pdf light_pdf(light_set, p);
+				auto direction = light_pdf.generate();
+				auto pdf = light_pdf.value(direction);
+				double value = 0;
+
+				hit_record rec;
+				if (pdf > 0 && world.hit(ray(p + vec3(0, 1e-4, 0), direction), interval(0, infinity), rec)) {
+					auto cosine = direction.y() / direction.length();
+					value = luminance(rec.mat->emitted(ray(p, direction), rec, rec.u, rec.v, rec.p)) * std::fmax(0.0, cosine) / pdf;
+				}
+				stats.add(value);
+			}
+			variance_sum += stats.m2 / (stats.count - 1);
+			mean_sum += stats.mean;
+		}
+		auto seconds = timer.seconds();
+		auto variance = variance_sum / point_count;
+		std::clog << name << ": mean " << mean_sum / point_count << ", variance " << variance << ", " << seconds << " s, efficiency "
+			<< 1 / (variance * seconds) << '\n';
+		return 1 / (variance * seconds);
+	};
+
+	light_sampler sampler(lights);
+	std::clog << light_count << " lights, " << point_count << " points x " << samples << " samples\n";
+	auto uniform = estimate(lights, "uniform list ");
+	auto weighted = estimate(sampler, "light_sampler");
+	std::clog << "Efficiency gain: " << weighted / uniform << "x\n";
+}
+
+//Counts the hit() calls that reach the wrapped object, to see how much of a scene a BVH culls
+class counted_hittable : public hittable {
+	public:
+		static inline std::uint64_t tests = 0;
+		static inline std::uint64_t hits = 0;
+
+		counted_hittable(shared_ptr<hittable> object) : object(object) {}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			tests++;
+			bool hit = object->hit(r, ray_t, rec);
+			hits += hit;
+			return hit;
+		}
+
+		aabb bounding_box() const override { return object->bounding_box(); }
+
+	private:
+		shared_ptr<hittable> object;
+};
+
+//Box-heavy scene three ways: six quads under rotate_y + translate per box (the old box()), the
+//same quads moved into world space as separate BVH primitives, and one oriented_box per box
+void benchmark_box_culling() {
+	auto white = benchmark_white();
+	const int count = 20'000;
+
+	hittable_list wrapped, faces, boxes;
+	thread_rng().reseed(11);
+	for (int i = 0; i < count; i++) {
+		auto size = vec3::random(2, 20);
+		auto angle = random_double(0, 360);
+		auto offset = point3::random(0, 1000);
+
+		hittable_list sides;
+		box_sides(point3(0, 0, 0), size, sides, [&](const point3& Q, const vec3& u, const vec3& v) { return make_shared<quad>(Q, u, v, white); });
+		shared_ptr<hittable> box_list = make_shared<hittable_list>(sides);
+		wrapped.add(make_shared<translate>(make_shared<rotate_y>(box_list, angle), offset));
+
+		auto radians = degrees_to_radians(angle);
+		auto rotate = [&](const vec3& p) { return vec3(std::cos(radians) * p.x() + std::sin(radians) * p.z(), p.y(), -std::sin(radians) * p.x() + std::cos(radians) * p.z()); };
+		box_sides(point3(0, 0, 0), size, faces, [&](const point3& Q, const vec3& u, const vec3& v) {
+			return make_shared<quad>(rotate(Q) + offset, rotate(u), rotate(v), white);
+		});
+
+		boxes.add(make_shared<oriented_box>(point3(0, 0, 0), size, angle, offset, white));
+	}
+	auto rays = probe_rays(boxes.bounding_box(), 200'000);
+
+	double base_rate = 0;
+	auto report = [&](const char* name, const hittable_list& objects) {
+		hittable_list counted;
+		for (const auto& object : objects.objects)
+			counted.add(make_shared<counted_hittable>(object));
+		bvh_node counted_tree(counted);
+		counted_hittable::tests = counted_hittable::hits = 0;
+		for (const auto& r : rays) {
+			hit_record rec;
+			counted_tree.hit(r, interval(0.001, infinity), rec);
+		}
+
+		bvh_node tree(objects);
+		std::clog << name << ": " << objects.objects.size() << " primitives, SAH cost " << tree.sah_cost() << ", "
+			<< double(counted_hittable::tests) / rays.size() << " tests per ray, " << 100.0 * counted_hittable::hits / counted_hittable::tests << "% hit";
+		auto rate = measure_rays(tree, rays);
+		if (base_rate == 0)
+			base_rate = rate;
+		std::clog << rate / 1e6 << " Mrays/s (" << rate / base_rate << "x)\n";
+	};
+
+	report("quad lists   ", wrapped);
+	report("world quads  ", faces);
+	report("oriented_box ", boxes);
+}
+
+//Closest hit against the early-exit occluded() query on every acceleration structure
+void benchmark_occlusion() {
+	auto objects = mixed_size_spheres(100'000);
+	auto rays = probe_rays(objects.bounding_box(), 200'000);
+
+	bvh_node tree(objects);
+	flat_bvh flat(tree);
+	bvh8 wide8(tree);
+	soa_bvh soa(tree);
+
+	auto report = [&](const char* name, const hittable& world) {
+		std::clog << name << ": hit";
+		auto hit_rate = measure_rays(world, rays);
+		std::clog << hit_rate / 1e6 << " Mrays/s, occluded";
+		auto occluded_rate = measure_occlusion(world, rays);
+		std::clog << occluded_rate / 1e6 << " Mrays/s (" << occluded_rate / hit_rate << "x)\n";
+	};
+
+	report("bvh_node", tree);
+	report("flat_bvh", flat);
+	report("bvh8    ", wide8);
+	report("soa_bvh ", soa);
+}
+
+/* Instancing
+*
+* One small model (a box with spheres around it) placed count times at random positions
+* and y rotations, once as instances of a single flat_bvh in a tlas and once with every
+* copy's primitives moved into world space under one big flat_bvh. Reports build time,
+* memory and ray rate of both, then moves 1% of the instances a little: the tlas refits
+* or rebuilds its top level while the copied scene has to rebuild everything.
+*/
+void benchmark_instancing() {
+	auto white = benchmark_white();
+	static const lambertian red_material(color(.65, .05, .05));
+	static const lambertian green_material(color(.12, .45, .15));
+	const material* palette[3] = { white, &red_material, &green_material };
+	const int count = 10'000;
+	const int spheres = 36;
+
+	//The model in its own space, box and spheres as separate parts so the copies can be placed the same way
+	vec3 box_size(4, 6, 4);
+	std::vector<point3> centers;
+	thread_rng().reseed(23);
+	for (int i = 0; i < spheres; i++)
+		centers.push_back(point3(2, 3, 2) + 4 * random_unit_vector());
+	const double radius = 0.6;
+
+	hittable_list model;
+	model.add(make_shared<oriented_box>(point3(0, 0, 0), box_size, white));
+	for (const auto& c : centers)
+		model.add(make_shared<sphere>(c, radius, white));
+
+	auto random_placement = []() {
+		return affine::translation(point3::random(0, 1000)) * affine::rotation(1, random_double(0, 360));
+	};
+	std::vector<affine> placements;
+	std::vector<const material*> overrides;
+	for (int i = 0; i < count; i++) {
+		placements.push_back(random_placement());
+		overrides.push_back(palette[i % 3]);
+	}
+
+	auto copies = [&]() {
+		hittable_list objects;
+		for (int i = 0; i < count; i++) {
+			const auto& m = placements[i];
+			objects.add(make_shared<oriented_box>(point3(0, 0, 0), box_size, m.vector(vec3(1, 0, 0)), m.vector(vec3(0, 1, 0)), m.point(point3(0, 0, 0)), overrides[i]));
+			for (const auto& c : centers)
+				objects.add(make_shared<sphere>(m.point(c), radius, overrides[i]));
+		}
+		return objects;
+	};
+	//Nodes, primitive pointers (leaf order and owning) and the primitives themselves
+	auto flat_bytes = [&](const flat_bvh& tree, size_t copy_count) {
+		return tree.node_count() * sizeof(flat_bvh_node) + tree.primitive_count() * (sizeof(const hittable*) + sizeof(shared_ptr<hittable>))
+			+ copy_count * (sizeof(oriented_box) + spheres * sizeof(sphere));
+	};
+
+	stopwatch copy_timer;
+	auto copy_world = std::make_unique<flat_bvh>(copies());
+	auto copy_seconds = copy_timer.seconds();
+
+	stopwatch instance_timer;
+	auto blas = make_shared<flat_bvh>(model);
+	tlas world;
+	for (int i = 0; i < count; i++)
+		world.add(blas, placements[i], overrides[i]);
+	world.build();
+	auto instance_seconds = instance_timer.seconds();
+
+	auto rays = probe_rays(world.bounding_box(), 200'000);
+
+	std::clog << count << " instances of " << model.objects.size() << " primitives\n";
+	std::clog << "copies: build " << copy_seconds << " s, " << flat_bytes(*copy_world, count) / 1e6 << " MB,";
+	auto copy_rate = measure_rays(*copy_world, rays);
+	std::clog << copy_rate / 1e6 << " Mrays/s\n";
+	std::clog << "tlas  : build " << instance_seconds << " s, " << (flat_bytes(*blas, 1) + world.memory_bytes()) / 1e6 << " MB ("
+		<< world.node_count() << " top nodes),";
+	auto instance_rate = measure_rays(world, rays);
+	std::clog << instance_rate / 1e6 << " Mrays/s (" << instance_rate / copy_rate << "x)\n";
+
+	//Move 1% a short way, as in an animation step, then update each structure
+	for (int i = 0; i < count; i += 100) {
+		placements[i] = affine::translation(vec3::random(-10, 10)) * placements[i] * affine::rotation(1, random_double(-30, 30));
+		world.set_transform(i, placements[i]);
+	}
+
+	stopwatch copy_rebuild_timer;
+	copy_world = std::make_unique<flat_bvh>(copies());
+	auto copy_rebuild_seconds = copy_rebuild_timer.seconds();
+
+	stopwatch refit_timer;
+	world.refit();
+	auto refit_seconds = refit_timer.seconds();
+	std::clog << "Moved " << count / 100 << " instances. copies rebuilt in " << copy_rebuild_seconds << " s, tlas refit in " << refit_seconds << " s,";
+	auto refit_rate = measure_rays(world, rays);
+	std::clog << refit_rate / 1e6 << " Mrays/s\n";
+
+	stopwatch rebuild_timer;
+	world.build();
+	auto rebuild_seconds = rebuild_timer.seconds();
+	std::clog << "tlas top level rebuilt in " << rebuild_seconds << " s,";
+	auto rebuild_rate = measure_rays(world, rays);
+	std::clog << rebuild_rate / 1e6 << " Mrays/s\n";
+}
+
+//Torus around the y axis with vertex normals and uvs, 2 * rings * sides triangles
+mesh_data torus_mesh(int rings, int sides, double major_radius, double minor_radius) {
+	mesh_data mesh;
+	for (int i = 0; i < rings; i++) {
+		auto phi = 2 * pi * i / rings;
+		vec3 radial(std::cos(phi), 0, std::sin(phi));
+		for (int j = 0; j < sides; j++) {
+			auto theta = 2 * pi * j / sides;
+			vec3 normal = std::cos(theta) * radial + vec3(0, std::sin(theta), 0);
+			mesh.positions.push_back(major_radius * radial + minor_radius * normal);
+			mesh.normals.push_back(normal);
+			mesh.uvs.push_back(real(double(i) / rings));
+			mesh.uvs.push_back(real(double(j) / sides));
+		}
+	}
+
+	auto vertex = [&](int i, int j) { return std::uint32_t((i % rings) * sides + (j % sides)); };
+	for (int i = 0; i < rings; i++) {
+		for (int j = 0; j < sides; j++) {
+			mesh.indices.insert(mesh.indices.end(), { vertex(i, j), vertex(i, j + 1), vertex(i + 1, j + 1) });
+			mesh.indices.insert(mesh.indices.end(), { vertex(i, j), vertex(i + 1, j + 1), vertex(i + 1, j) });
+		}
+	}
+	return mesh;
+}
+
+//Sample assets for the loader benchmark: OBJ with v/vt/vn corners, and little or big endian PLY as the host writes it
+bool save_obj(const mesh_data& mesh, const std::string& path) {
+	std::ofstream file(path, std::ios::binary);
+	std::string buffer;
+	char number[32];
+	auto put = [&](double x) {
+		auto end = std::to_chars(number, number + sizeof(number), float(x)).ptr;
+		buffer.push_back(' ');
+		buffer.append(number, end);
+	};
+	auto flush = [&](bool force) {
+		if (force || buffer.size() > (1 << 20)) {
+			file.write(buffer.data(), std::streamsize(buffer.size()));
+			buffer.clear();
+		}
+	};
+
+	for (const auto& p : mesh.positions) {
+		buffer += 'v';
+		put(p.x()); put(p.y()); put(p.z());
+		buffer += '\n';
+		flush(false);
+	}
+	for (size_t i = 0; i < mesh.uvs.size(); i += 2) {
+		buffer += "vt";
+		put(mesh.uvs[i]); put(mesh.uvs[i + 1]);
+		buffer += '\n';
+		flush(false);
+	}
+	for (const auto& n : mesh.normals) {
+		buffer += "vn";
+		put(n.x()); put(n.y()); put(n.z());
+		buffer += '\n';
+		flush(false);
+	}
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		buffer += 'f';
+		for (int k = 0; k < 3; k++) {
+			auto index = std::to_string(mesh.indices[i + k] + 1);
+			buffer += ' ' + index + '/' + index + '/' + index;
+		}
+		buffer += '\n';
+		flush(false);
+	}
+	flush(true);
+	return bool(file);
+}
+
+bool save_ply(const mesh_data& mesh, const std::string& path) {
+	const std::uint16_t probe = 1;
+	bool little = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+
+	std::ofstream file(path, std::ios::binary);
+	file << "ply\nformat " << (little ? "binary_little_endian" : "binary_big_endian") << " 1.0\n"
+		<< "element vertex " << mesh.positions.size() << "\n"
+		<< "property float x\nproperty float y\nproperty float z\n"
+		<< "property float nx\nproperty float ny\nproperty float nz\n"
+		<< "property float u\nproperty float v\n"
+		<< "element face " << mesh.triangle_count() << "\n"
+		<< "property list uchar int vertex_indices\nend_header\n";
+
+	std::vector<char> buffer;
+	auto put = [&](const void* data, size_t size) {
+		auto bytes = static_cast<const char*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	};
+	for (size_t i = 0; i < mesh.positions.size(); i++) {
+		float vertex[8] = { float(mesh.positions[i].x()), float(mesh.positions[i].y()), float(mesh.positions[i].z()),
+			float(mesh.normals[i].x()), float(mesh.normals[i].y()), float(mesh.normals[i].z()), float(mesh.uvs[2 * i]), float(mesh.uvs[2 * i + 1]) };
+		put(vertex, sizeof(vertex));
+	}
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		unsigned char count = 3;
+		std::int32_t face[3] = { std::int32_t(mesh.indices[i]), std::int32_t(mesh.indices[i + 1]), std::int32_t(mesh.indices[i + 2]) };
+		put(&count, 1);
+		put(face, sizeof(face));
+	}
+	file.write(buffer.data(), std::streamsize(buffer.size()));
+	return bool(file);
+}
+
+//Removes the listed files when it goes out of scope, whichever way the benchmark exits
+struct temporary_files {
+	std::vector<std::string> paths;
+
+	~temporary_files() {
+		std::error_code ignored;
+		for (const auto& path : paths)
+			std::filesystem::remove(path, ignored);
+	}
+};
+
+/* Mesh Loading
+*
+* Writes a 2M-triangle torus as OBJ and binary PLY to the temporary directory, loads
+* each on one thread and on all of them (load_mesh() reports time and triangles/s),
+* then builds a triangle_mesh from it and traces rays against it.
+*/
+void benchmark_mesh_loading() {
+	auto white = benchmark_white();
+	auto torus = torus_mesh(1000, 1000, 100, 30);
+	auto directory = std::filesystem::temp_directory_path();
+	auto obj_path = (directory / "srt_torus.obj").string();
+	auto ply_path = (directory / "srt_torus.ply").string();
+	temporary_files cleanup{ { obj_path, ply_path } };
+
+	stopwatch write_timer;
+	if (!save_obj(torus, obj_path) || !save_ply(torus, ply_path)) {
+		std::cerr << "ERROR: Could not write the sample meshes to '" << directory.string() << "'.\n";
+		return;
+	}
+	std::clog << "Wrote " << torus.triangle_count() << " triangles as OBJ (" << std::filesystem::file_size(obj_path) / 1e6 << " MB) and PLY ("
+		<< std::filesystem::file_size(ply_path) / 1e6 << " MB) in " << write_timer.seconds() << " s\n";
+
+	std::vector<int> thread_counts = { 1 };
+	int threads = resolve_thread_count(0);
+	if (threads > 1)
+		thread_counts.push_back(threads);
+
+	mesh_data loaded;
+	for (const auto& path : { obj_path, ply_path }) {
+		for (int thread_count : thread_counts) {
+			std::clog << thread_count << " thread(s): ";
+			if (!load_mesh(path, loaded, thread_count))
+				return;
+			if (loaded.triangle_count() != torus.triangle_count() || loaded.positions.size() != torus.positions.size())
+				std::cerr << "ERROR: '" << path << "' loaded with a different size than was written.\n";
+		}
+	}
+
+	stopwatch build_timer;
+	auto buffers = make_shared<const mesh_data>(std::move(loaded));
+	triangle_mesh mesh(buffers, white);
+	std::clog << "triangle_mesh: built in " << build_timer.seconds() << " s, " << mesh.node_count() << " nodes, "
+		<< (buffers->memory_bytes() + mesh.memory_bytes()) / 1e6 << " MB,";
+	auto rays = probe_rays(mesh.bounding_box(), 200'000);
+	auto rate = measure_rays(mesh, rays);
+	std::clog << rate / 1e6 << " Mrays/s\n";
+}
+
+#endif
\ No newline at end of file
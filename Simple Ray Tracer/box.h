@@ -0,0 +1,179 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include "hittable.h"
+
+#include <utility>
+
+/* Oriented Box
+*
+* A box as one primitive instead of six quads in a hittable_list under rotate_y and
+* translate. The box spans [lo, hi] in a frame of three orthonormal axes placed at
+* origin. A ray is moved into the frame once and a single slab test finds the face it
+* enters through, or leaves through when it starts inside. That face gives the normal
+* and (u, v), laid out like the quads of box_sides() so textures map the same way.
+* Bounds are the box around the eight corners, as tight as an aabb of it gets.
+*/
+class oriented_box : public hittable {
+	public:
+		//Axis-aligned, a and b are opposite corners
+		oriented_box(const point3& a, const point3& b, const material* mat)
+			: oriented_box(a, b, vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 0), mat) {}
+
+		//Corners a and b rotated about y by angle degrees, then moved by offset, like rotate_y then translate
+		oriented_box(const point3& a, const point3& b, double angle, const vec3& offset, const material* mat)
+			: oriented_box(a, b, vec3(std::cos(degrees_to_radians(angle)), 0, -std::sin(degrees_to_radians(angle))),
+				vec3(0, 1, 0), offset, mat) {}
+
+		//Corners a and b in the frame with x axis axis_x and y axis axis_y (made orthonormal, z = x cross y), placed at offset
+		oriented_box(const point3& a, const point3& b, const vec3& axis_x, const vec3& axis_y, const vec3& offset, const material* mat)
+			: origin(offset), mat(mat) {
+			axis[0] = unit_vector(axis_x);
+			axis[2] = unit_vector(cross(axis[0], axis_y));
+			axis[1] = cross(axis[2], axis[0]);
+
+			for (int i = 0; i < 3; i++) {
+				lo[i] = std::fmin(a[i], b[i]);
+				hi[i] = std::fmax(a[i], b[i]);
+			}
+
+			point3 min(infinity, infinity, infinity);
+			point3 max(-infinity, -infinity, -infinity);
+			for (int corner = 0; corner < 8; corner++) {
+				auto p = to_world(point3(corner & 1 ? hi[0] : lo[0], corner & 2 ? hi[1] : lo[1], corner & 4 ? hi[2] : lo[2]));
+				for (int c = 0; c < 3; c++) {
+					min[c] = std::fmin(min[c], p[c]);
+					max[c] = std::fmax(max[c], p[c]);
+				}
+			}
+			bbox = aabb(interval(min.x(), max.x()), interval(min.y(), max.y()), interval(min.z(), max.z())); //Pads flat boxes
+
+			auto dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+			area = 2 * (dx * dy + dy * dz + dz * dx);
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			point3 o;
+			vec3 d;
+			to_local(r, o, d);
+
+			real t;
+			int face;
+			if (!slab(o, d, ray_t, t, face))
+				return false;
+
+			//Snapped onto the face, so only the transform back rounds the point off it
+			int a = face / 2;
+			bool upper = face % 2;
+			point3 local = o + t * d;
+			local[a] = upper ? hi[a] : lo[a];
+
+			rec.s = t;
+			rec.p = to_world(local);
+			rec.p_error = 16 * std::numeric_limits<real>::epsilon() * (max_abs(origin) + max_abs(local));
+			rec.set_face_normal(r, upper ? axis[a] : -axis[a]);
+			face_uv(face, local, rec.u, rec.v);
+			rec.mat = mat;
+
+			return true;
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			point3 o;
+			vec3 d;
+			to_local(r, o, d);
+
+			real t;
+			int face;
+			return slab(o, d, ray_t, t, face);
+		}
+
+		aabb bounding_box() const override { return bbox; }
+
+		double surface_area() const override { return area; }
+		const material* surface_material() const override { return mat; }
+
+	private:
+		point3 origin;
+		vec3 axis[3]; //Orthonormal frame
+		real lo[3], hi[3];
+		const material* mat;
+		aabb bbox;
+		real area;
+
+		void to_local(const ray& r, point3& o, vec3& d) const {
+			vec3 from_origin = r.origin() - origin;
+			o = point3(dot(from_origin, axis[0]), dot(from_origin, axis[1]), dot(from_origin, axis[2]));
+			d = vec3(dot(r.direction(), axis[0]), dot(r.direction(), axis[1]), dot(r.direction(), axis[2]));
+		}
+
+		point3 to_world(const point3& local) const {
+			return origin + local.x() * axis[0] + local.y() * axis[1] + local.z() * axis[2];
+		}
+
+		//Faces are 2 * axis + (1 on the hi side), the nearest crossing inside ray_t wins
+		bool slab(const point3& o, const vec3& d, const interval& ray_t, real& t, int& face) const {
+			real t_near = -infinity, t_far = infinity;
+			int near_face = 0, far_face = 0;
+
+			for (int a = 0; a < 3; a++) {
+				const real inv = 1 / d[a];
+				real t0 = (lo[a] - o[a]) * inv;
+				real t1 = (hi[a] - o[a]) * inv;
+				int f0 = 2 * a, f1 = 2 * a + 1;
+				if (inv < 0) {
+					std::swap(t0, t1);
+					std::swap(f0, f1);
+				}
+
+				if (t0 > t_near) {
+					t_near = t0;
+					near_face = f0;
+				}
+				if (t1 < t_far) {
+					t_far = t1;
+					far_face = f1;
+				}
+			}
+
+			if (t_near > t_far)
+				return false;
+
+			if (ray_t.contains(t_near)) {
+				t = t_near;
+				face = near_face;
+				return true;
+			}
+			if (ray_t.contains(t_far)) {
+				t = t_far;
+				face = far_face;
+				return true;
+			}
+			return false;
+		}
+
+		//(u, v) of the quad box_sides() puts on that face
+		void face_uv(int face, const point3& local, real& u, real& v) const {
+			//u axis, u reversed, v axis, v reversed: left, right, bottom, top, back, front
+			static constexpr int layout[6][4] = {
+				{ 2, 0, 1, 0 }, { 2, 1, 1, 0 },
+				{ 0, 0, 2, 0 }, { 0, 0, 2, 1 },
+				{ 0, 1, 1, 0 }, { 0, 0, 1, 0 }
+			};
+
+			const int* l = layout[face];
+			u = (local[l[0]] - lo[l[0]]) / (hi[l[0]] - lo[l[0]]);
+			v = (local[l[2]] - lo[l[2]]) / (hi[l[2]] - lo[l[2]]);
+			if (l[1])
+				u = 1 - u;
+			if (l[3])
+				v = 1 - v;
+		}
+};
+
+//Box with opposite vertices a and b as a single primitive
+inline shared_ptr<oriented_box> box(const point3& a, const point3& b, const material* mat) {
+	return make_shared<oriented_box>(a, b, mat);
+}
+
+#endif
\ No newline at end of file
@@ -7,22 +7,77 @@
 
 #include <algorithm>
 
+//Split strategy used when building a bvh_node
+enum class bvh_split {
+	median, //Sort on the longest axis and split at the object-count midpoint
+	sah     //Binned Surface Area Heuristic, falls back to median when binning cannot separate the objects
+};
+
+//Bin of a centroid at f = bins * (centroid - extent.min) / extent.size(), clamped to [0, bins). Non-finite centroids (empty boxes) land in the first bin
+template <int bins, typename T>
+int clamp_bin(T f) {
+	if (!(f > 0))
+		return 0;
+	return f < bins ? int(f) : bins - 1;
+}
+
+template <int bins>
+int sah_bin(double centroid, const interval& extent) {
+	return clamp_bin<bins>(bins * (centroid - extent.min) / extent.size());
+}
+
+/* Binned SAH Sweep
+*
+* Scores every boundary between the bins of one axis by SA(left) * N(left) +
+* SA(right) * N(right), sweeping from the right to collect the suffix areas and then
+* from the left to score each boundary. A boundary cheaper than best_cost replaces the
+* best so far. Box is aabb or any box that default-constructs empty and has a union
+* constructor Box(a, b) and surface_area().
+*/
+template <typename Box, int bins>
+void sah_sweep(const Box (&bin_bounds)[bins], const size_t (&bin_counts)[bins], int axis, double& best_cost, int& best_axis, int& best_split) {
+	decltype(bin_bounds[0].surface_area()) right_area[bins];
+	size_t right_count[bins];
+	Box accum;
+	size_t count = 0;
+	for (int bin = bins - 1; bin > 0; bin--) {
+		accum = Box(accum, bin_bounds[bin]);
+		count += bin_counts[bin];
+		right_area[bin] = accum.surface_area();
+		right_count[bin] = count;
+	}
+
+	accum = Box();
+	count = 0;
+	for (int split = 1; split < bins; split++) {
+		accum = Box(accum, bin_bounds[split - 1]);
+		count += bin_counts[split - 1];
+		if (count == 0 || right_count[split] == 0)
+			continue;
+
+		double split_cost = accum.surface_area() * count + right_area[split] * right_count[split];
+		if (split_cost < best_cost) {
+			best_cost = split_cost;
+			best_axis = axis;
+			best_split = split;
+		}
+	}
+}
+
 //Bounding Volume Hierarchy
 class bvh_node : public hittable {
 	public:
-		bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {} //Implicit copy of hittable_list
+		//Relative costs of one node visit and one primitive test, as used by sah_cost()
+		static constexpr double traversal_cost = 1.0;
+		static constexpr double intersection_cost = 1.0;
+
+		bvh_node(hittable_list list, bvh_split split = bvh_split::sah) : bvh_node(list.objects, 0, list.objects.size(), split) {} //Implicit copy of hittable_list
 
-		bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+		bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, bvh_split split = bvh_split::sah) {
 			bbox = aabb::empty;
 			for (size_t object_index = start; object_index < end; object_index++)
 				bbox = aabb(bbox, objects[object_index]->bounding_box());
 
-			int axis = bbox.longest_axis();
-
-			auto comparator = (axis == 0) ? box_x_compare
-							: (axis == 1) ? box_y_compare
-										  : box_z_compare;
-
 			size_t object_span = end - start;
 
 			if (object_span == 1) {
@@ -33,13 +88,24 @@ class bvh_node : public hittable {
 				right = objects[start + 1];
 			}
 			else {
-				std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
-				auto mid = start + object_span / 2;
-				left = make_shared<bvh_node>(objects, start, mid);
-				right = make_shared<bvh_node>(objects, mid, end);
+				size_t mid = 0;
+				if (split == bvh_split::sah)
+					mid = partition_sah(objects, start, end);
+				if (mid == 0)
+					mid = partition_median(objects, start, end);
+
+				left = make_shared<bvh_node>(objects, start, mid, split);
+				right = make_shared<bvh_node>(objects, mid, end, split);
 			}
 
 			bbox = aabb(left->bounding_box(), right->bounding_box());
+			cost = traversal_cost + child_cost(left) + child_cost(right);
+		}
+
+		//Node over two finished children, how bvh_builder assembles its trees bottom-up
+		bvh_node(shared_ptr<hittable> left, shared_ptr<hittable> right) : left(left), right(right) {
+			bbox = aabb(left->bounding_box(), right->bounding_box());
+			cost = traversal_cost + child_cost(left) + child_cost(right);
 		}
 
 		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
@@ -52,12 +118,102 @@ class bvh_node : public hittable {
 			return hit_left || hit_right;
 		}
 
+		bool occluded(const ray& r, interval ray_t) const override {
+			if (!bbox.hit(r, ray_t))
+				return false;
+
+			return left->occluded(r, ray_t) || (right != left && right->occluded(r, ray_t));
+		}
+
 		aabb bounding_box() const override { return bbox; }
 
+		/* Expected cost of a ray that reaches this node
+		*
+		* C(node) = C_trav + sum over children of P(child | node) * C(child)
+		* P(child | node) = SA(child) / SA(node), C(primitive) = C_isect
+		*/
+		double sah_cost() const { return cost; }
+
+		const shared_ptr<hittable>& left_child() const { return left; }
+		const shared_ptr<hittable>& right_child() const { return right; }
+
 	private:
+		friend class bvh_builder; //Bins and splits exactly like the constructor above
+
 		shared_ptr<hittable> left;
 		shared_ptr<hittable> right;
 		aabb bbox;
+		double cost;
+
+		static constexpr int bin_count = 16;
+
+		double child_cost(const shared_ptr<hittable>& child) const {
+			auto area = bbox.surface_area();
+			auto probability = area > 0 ? child->bounding_box().surface_area() / area : 1.0;
+
+			auto node = dynamic_cast<const bvh_node*>(child.get());
+			return probability * (node ? node->cost : intersection_cost);
+		}
+
+		//Sorts [start, end) on the longest axis and returns the midpoint
+		size_t partition_median(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) const {
+			int axis = bbox.longest_axis();
+
+			auto comparator = (axis == 0) ? box_x_compare
+							: (axis == 1) ? box_y_compare
+										  : box_z_compare;
+
+			std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
+			return start + (end - start) / 2;
+		}
+
+		/* Binned SAH (Wald 2007)
+		*
+		* Object centroids are dropped into bin_count equal bins along each axis, and every
+		* bin boundary is scored by SA(left) * N(left) + SA(right) * N(right). The objects are
+		* partitioned around the cheapest boundary. Returns 0 if no boundary separates them.
+		*/
+		size_t partition_sah(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) const {
+			aabb centroid_bounds = aabb::empty;
+			for (size_t i = start; i < end; i++) {
+				auto c = objects[i]->bounding_box().centroid();
+				if (std::isfinite(c.x()) && std::isfinite(c.y()) && std::isfinite(c.z()))
+					centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+			}
+
+			int best_axis = -1;
+			int best_split = 0;
+			auto best_cost = infinity;
+
+			for (int axis = 0; axis < 3; axis++) {
+				const interval& extent = centroid_bounds.axis_interval(axis);
+				if (!(extent.size() > 0))
+					continue;
+
+				aabb bin_bounds[bin_count];
+				size_t bin_counts[bin_count] = {};
+
+				for (size_t i = start; i < end; i++) {
+					auto object_box = objects[i]->bounding_box();
+					int bin = sah_bin<bin_count>(object_box.centroid()[axis], extent);
+					bin_counts[bin]++;
+					bin_bounds[bin] = aabb(bin_bounds[bin], object_box);
+				}
+
+				sah_sweep(bin_bounds, bin_counts, axis, best_cost, best_axis, best_split);
+			}
+
+			if (best_axis < 0)
+				return 0;
+
+			const interval& extent = centroid_bounds.axis_interval(best_axis);
+			auto middle = std::partition(std::begin(objects) + start, std::begin(objects) + end,
+				[&](const shared_ptr<hittable>& object) {
+					return sah_bin<bin_count>(object->bounding_box().centroid()[best_axis], extent) < best_split;
+				});
+
+			return size_t(middle - std::begin(objects));
+		}
 
 		static bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index) {
 			auto a_axis_interval = a->bounding_box().axis_interval(axis_index);
@@ -0,0 +1,264 @@
+#ifndef BVH_BUILDER_H
+#define BVH_BUILDER_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+/* Parallel BVH Builder
+*
+* Builds the same bvh_node tree as its constructor (same bins, costs and splits, so
+* the same quality) on thread_count threads. The constructor asks every object for
+* its box again at every level and copies the list on entry. Here each box and
+* centroid is computed once, in parallel, and the builder moves 32-bit indices around
+* instead of shared_ptrs. Median splits select the middle with nth_element rather than
+* sorting the range.
+*
+* Threads are handed out as a budget. The root owns all of them, and a node with a
+* budget above one builds its children as two tasks, the left asynchronously, with
+* the budget split in proportion to their sizes. Near the top, where a few large nodes
+* would otherwise leave threads idle, a node of at least parallel_grain objects also
+* bins and partitions its range with all of its budget.
+*/
+class bvh_builder {
+	public:
+		int thread_count = 0; //0 -> all cores
+		bvh_split split = bvh_split::sah;
+
+		//nullptr for an empty list. The objects are shared with the list, not copied
+		shared_ptr<bvh_node> build(const hittable_list& list) {
+			auto start_time = std::chrono::steady_clock::now();
+			threads_used = resolve_thread_count(thread_count);
+
+			objects = &list.objects;
+			auto count = objects->size();
+			boxes.resize(count);
+			centroids.resize(count);
+			order.resize(count);
+			scratch.resize(count);
+
+			shared_ptr<bvh_node> root;
+			if (count > 0) {
+				for_ranges(0, count, parts_for(count, threads_used), [&](size_t begin, size_t end, int) {
+					for (size_t i = begin; i < end; i++) {
+						boxes[i] = (*objects)[i]->bounding_box();
+						centroids[i] = boxes[i].centroid();
+						order[i] = std::uint32_t(i);
+					}
+				});
+				root = build_node(0, count, threads_used);
+			}
+
+			boxes = std::vector<aabb>();
+			centroids = std::vector<point3>();
+			order = std::vector<std::uint32_t>();
+			scratch = std::vector<std::uint32_t>();
+			objects = nullptr;
+
+			build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+			return root;
+		}
+
+		//Of the last build()
+		double seconds() const { return build_seconds; }
+		int threads() const { return threads_used; }
+
+	private:
+		static constexpr size_t parallel_grain = 1 << 15; //Smallest range binned and partitioned by several threads
+		static constexpr size_t task_grain = 1 << 10;     //Smallest range split into two tasks
+		static constexpr int bin_count = bvh_node::bin_count;
+
+		const std::vector<shared_ptr<hittable>>* objects = nullptr;
+		std::vector<aabb> boxes;           //Per object, in list order
+		std::vector<point3> centroids;
+		std::vector<std::uint32_t> order;  //Objects of each subtree contiguous
+		std::vector<std::uint32_t> scratch; //Out-of-place partition buffer, same ranges as order
+		double build_seconds = 0;
+		int threads_used = 1;
+
+		//Per-thread binning of one range, merged afterwards
+		struct bins {
+			aabb bounds[3][bin_count];
+			size_t counts[3][bin_count] = {};
+		};
+
+		static int parts_for(size_t count, int budget) {
+			return int(std::min<size_t>(size_t(budget), count / parallel_grain + 1));
+		}
+
+		//work(begin, end, part) over parts contiguous slices of [start, end)
+		template <typename Work>
+		static void for_ranges(size_t start, size_t end, int parts, Work&& work) {
+			auto span = end - start;
+			run_parts(parts, [&](int part) {
+				work(start + span * part / parts, start + span * (part + 1) / parts, part);
+			});
+		}
+
+		shared_ptr<bvh_node> build_node(size_t start, size_t end, int budget) {
+			auto span = end - start;
+			if (span == 1)
+				return make_shared<bvh_node>((*objects)[order[start]], (*objects)[order[start]]);
+			if (span == 2)
+				return make_shared<bvh_node>((*objects)[order[start]], (*objects)[order[start + 1]]);
+
+			int parts = parts_for(span, budget);
+
+			//Node box and the box of the finite centroids, as the constructor computes them
+			aabb bbox = aabb::empty, centroid_bounds = aabb::empty;
+			if (parts == 1) {
+				range_bounds(start, end, bbox, centroid_bounds);
+			}
+			else {
+				std::vector<aabb> part_bounds(parts, aabb::empty), part_centroids(parts, aabb::empty);
+				for_ranges(start, end, parts, [&](size_t begin, size_t stop, int part) {
+					range_bounds(begin, stop, part_bounds[part], part_centroids[part]);
+				});
+				for (int part = 0; part < parts; part++) {
+					bbox = aabb(bbox, part_bounds[part]);
+					centroid_bounds = aabb(centroid_bounds, part_centroids[part]);
+				}
+			}
+
+			size_t mid = start;
+			if (split == bvh_split::sah)
+				mid = partition_sah(start, end, centroid_bounds, parts);
+			if (mid == start)
+				mid = partition_median(start, end, bbox.longest_axis());
+
+			shared_ptr<bvh_node> left, right;
+			if (budget > 1 && span >= task_grain) {
+				auto share = std::lround(budget * double(mid - start) / span);
+				int left_budget = int(std::clamp<long>(share, 1, budget - 1));
+				//A future, unlike a bare thread, is waited for even if the right half throws
+				auto worker = std::async(std::launch::async, [&]() { return build_node(start, mid, left_budget); });
+				right = build_node(mid, end, budget - left_budget);
+				left = worker.get();
+			}
+			else {
+				left = build_node(start, mid, 1);
+				right = build_node(mid, end, 1);
+			}
+			return make_shared<bvh_node>(left, right);
+		}
+
+		void range_bounds(size_t begin, size_t end, aabb& bbox, aabb& centroid_bounds) const {
+			for (size_t i = begin; i < end; i++) {
+				bbox = aabb(bbox, boxes[order[i]]);
+				const point3& c = centroids[order[i]];
+				if (std::isfinite(c.x()) && std::isfinite(c.y()) && std::isfinite(c.z()))
+					centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+			}
+		}
+
+		void bin_range(size_t begin, size_t end, const aabb& centroid_bounds, bins& b) const {
+			for (int axis = 0; axis < 3; axis++) {
+				const interval& extent = centroid_bounds.axis_interval(axis);
+				if (!(extent.size() > 0))
+					continue;
+				for (size_t i = begin; i < end; i++) {
+					auto object = order[i];
+					int bin = sah_bin<bin_count>(centroids[object][axis], extent);
+					b.counts[axis][bin]++;
+					b.bounds[axis][bin] = aabb(b.bounds[axis][bin], boxes[object]);
+				}
+			}
+		}
+
+		//bvh_node::partition_sah with the binning split across parts threads. Returns start if no boundary separates the objects
+		size_t partition_sah(size_t start, size_t end, const aabb& centroid_bounds, int parts) {
+			bins merged;
+			if (parts == 1) {
+				bin_range(start, end, centroid_bounds, merged);
+			}
+			else {
+				std::vector<bins> part_bins(parts);
+				for_ranges(start, end, parts, [&](size_t begin, size_t stop, int part) {
+					bin_range(begin, stop, centroid_bounds, part_bins[part]);
+				});
+				for (const auto& b : part_bins) {
+					for (int axis = 0; axis < 3; axis++) {
+						for (int bin = 0; bin < bin_count; bin++) {
+							merged.counts[axis][bin] += b.counts[axis][bin];
+							merged.bounds[axis][bin] = aabb(merged.bounds[axis][bin], b.bounds[axis][bin]);
+						}
+					}
+				}
+			}
+
+			int best_axis = -1;
+			int best_split = 0;
+			auto best_cost = infinity;
+			for (int axis = 0; axis < 3; axis++) {
+				if (!(centroid_bounds.axis_interval(axis).size() > 0))
+					continue;
+
+				sah_sweep(merged.bounds[axis], merged.counts[axis], axis, best_cost, best_axis, best_split);
+			}
+
+			if (best_axis < 0)
+				return start;
+
+			const interval& extent = centroid_bounds.axis_interval(best_axis);
+			auto goes_left = [&](std::uint32_t object) { return sah_bin<bin_count>(centroids[object][best_axis], extent) < best_split; };
+			if (parts == 1)
+				return size_t(std::partition(order.begin() + start, order.begin() + end, goes_left) - order.begin());
+
+			//Stable partition in three parallel passes: count each part's left objects, scatter into scratch, copy back
+			std::vector<size_t> left_counts(parts);
+			for_ranges(start, end, parts, [&](size_t begin, size_t stop, int part) {
+				left_counts[part] = size_t(std::count_if(order.begin() + begin, order.begin() + stop, goes_left));
+			});
+			size_t left_total = 0;
+			for (auto n : left_counts)
+				left_total += n;
+
+			std::vector<size_t> left_offsets(parts), right_offsets(parts);
+			size_t left_offset = start, right_offset = start + left_total;
+			for (int part = 0; part < parts; part++) {
+				auto part_size = (end - start) * (part + 1) / parts - (end - start) * part / parts;
+				left_offsets[part] = left_offset;
+				right_offsets[part] = right_offset;
+				left_offset += left_counts[part];
+				right_offset += part_size - left_counts[part];
+			}
+
+			for_ranges(start, end, parts, [&](size_t begin, size_t stop, int part) {
+				auto l = left_offsets[part], r = right_offsets[part];
+				for (size_t i = begin; i < stop; i++)
+					scratch[goes_left(order[i]) ? l++ : r++] = order[i];
+			});
+			for_ranges(start, end, parts, [&](size_t begin, size_t stop, int) {
+				std::copy(scratch.begin() + begin, scratch.begin() + stop, order.begin() + begin);
+			});
+			return start + left_total;
+		}
+
+		//The constructor's median split on the lower box edge along axis, selected instead of sorted
+		size_t partition_median(size_t start, size_t end, int axis) {
+			auto mid = start + (end - start) / 2;
+			std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+				return boxes[a].axis_interval(axis).min < boxes[b].axis_interval(axis).min;
+			});
+			return mid;
+		}
+};
+
+//Tree over a non-empty list built on thread_count threads (0 -> all cores), how the flat layouts build from a list
+inline shared_ptr<bvh_node> build_bvh(const hittable_list& list, bvh_split split = bvh_split::sah, int thread_count = 0) {
+	bvh_builder builder;
+	builder.thread_count = thread_count;
+	builder.split = split;
+	return builder.build(list);
+}
+
+#endif
\ No newline at end of file
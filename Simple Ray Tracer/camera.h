@@ -1,16 +1,42 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "accumulation_buffer.h"
+#include "alloc_counter.h"
+#include "flat_bvh.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "image_writer.h"
+#include "light_sampler.h"
 #include "pdf.h"
 #include "material.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+//How camera::shade estimates the light arriving at a surface
+enum class integrator {
+	mixture, //One direction from a 50/50 mix of the light and BSDF pdfs, emission found by continuing the path
+	nee_mis  //Next-event estimation: a shadow ray to a sampled light plus a BSDF sample, weighted by MIS
+};
+
+//What a render produced, for comparing settings
+struct render_stats {
+	double seconds = 0;
+	double samples_per_pixel = 0;
+	double relative_error = 0; //accumulation_buffer::image_relative_error()
+};
 
 class camera {
 	public:
 		double aspect_ratio = 1.0;
 		int    image_width = 100;
 		int    samples_per_pixel = 10;
-		int    max_depth = 10;
+		int    max_depth = 10;    //Hard cap on path segments
+		int    rr_min_depth = 3;  //Segments before Russian roulette may end a path, >= max_depth disables it
 		color  background;
 
 		double vfov = 90;
@@ -21,36 +47,125 @@ class camera {
 		double defocus_angle = 0;
 		double focus_dist = 10;
 
-		//Outputs color values to stream in PPM format
-		void render(const hittable& world, const hittable& lights) {
+		int thread_count = 0; //0 -> std::thread::hardware_concurrency()
+		int tile_size = 16;
+		std::uint64_t seed = 0; //Every pixel sample is seeded from (seed, pixel, sample)
+		bool packet_tracing = true; //Trace primary rays, and nee_mis's first shadow rays, in 4x4 packets when the world is a flat_bvh
+
+		std::string  output_path;                             //Empty -> stdout
+		image_format output_format = image_format::automatic; //From output_path's extension, P6 for stdout
+
+		int         samples_per_pass = 16;   //Samples added to every pixel per progressive pass
+		std::string checkpoint_path;         //Empty -> no checkpoints
+		double      checkpoint_interval = 60; //Seconds between checkpoint writes
+		bool        resume = false;          //Continue from checkpoint_path when it matches this image and seed
+
+		bool        adaptive_sampling = false; //Stop sampling each pixel once its estimate reaches target_error
+		int         min_samples = 16;          //Adaptive: samples every pixel takes before it may stop
+		int         max_samples = 1024;        //Adaptive: cap for the noisiest pixels, replaces samples_per_pixel
+		double      target_error = 0.02;       //Adaptive: standard error of the mean luminance relative to the mean
+		std::string heatmap_path;              //Samples taken per pixel as an image, empty -> none
+
+		bool light_sampling = true; //Pick lights by power through a light_sampler, false -> uniformly from the list
+		integrator path_integrator = integrator::mixture;
+
+		double time_limit = 0; //Seconds, no further passes start once exceeded. 0 -> no limit
+
+		/* Progressive Render
+		*
+		* Passes of samples_per_pass samples are rendered tile-parallel into an accumulation
+		* buffer. After a pass, once checkpoint_interval has elapsed, the buffer is saved to
+		* checkpoint_path (and a preview written to output_path, if it is a file). The last
+		* pass always checkpoints. The resolved image is written with the selected image writer.
+		*
+		* With adaptive_sampling every pixel first takes min_samples, then keeps taking passes
+		* only while its relative error is above target_error, up to max_samples. Samples are
+		* jittered over the whole pixel instead of stratified, so every prefix is unbiased.
+		*
+		* With light_sampling the lights are wrapped in a light_sampler for the whole render.
+		* A time_limit ends the render after the pass during which it runs out, so renders
+		* with different settings can be compared at equal time.
+		*/
+		render_stats render(const hittable& world, const hittable& light_list) {
 			initialize();
-
-			std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-			for (int j = 0; j < image_height; j++) {
-				std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-				for (int i = 0; i < image_width; i++) {
-					color pixel_color(0, 0, 0);
-					for (int s_j = 0; s_j < sqrt_spp; s_j++) { //Stratified
-						for (int s_i = 0; s_i < sqrt_spp; s_i++) {
-							ray r = get_ray(i, j, s_i, s_j);
-							pixel_color += ray_color(r, max_depth, world, lights);
-						}
-					}
-
-					color scaled_color = pixel_samples_scale * pixel_color; //Temp
-					write_color(std::cout, scaled_color); // (pixel_samples_scale * pixel_color) complier error as second arg?
+			auto start = std::chrono::steady_clock::now();
+
+			light_sampler sampler(light_list);
+			const hittable& lights = light_sampling ? static_cast<const hittable&>(sampler) : light_list;
+
+			accumulation_buffer accum(image_width, image_height);
+			accum.seed = seed;
+			accum.sample_grid = adaptive_sampling ? 0 : sqrt_spp;
+			if (resume && !checkpoint_path.empty())
+				resume_from_checkpoint(accum);
+
+			auto tiles = make_tiles(image_width, image_height, tile_size);
+			tile_scheduler scheduler(thread_count);
+
+			int passes = (sample_limit + pass_size - 1) / pass_size;
+			std::clog << "Rendering " << tiles.size() << " tiles x " << (adaptive_sampling ? "at most " : "") << passes
+				<< " passes on " << scheduler.threads() << " threads\n";
+
+			auto samples_before = accum.total_samples();
+			std::atomic<std::uint64_t> allocations{ 0 };
+			render_progress progress(tiles.size() * passes);
+			auto last_checkpoint = std::chrono::steady_clock::now();
+
+			auto active = active_pixels(accum);
+			while (active > 0) {
+				scheduler.run(tiles, [&](const tile& t, int) {
+					ray_counter = 0;
+					auto allocations_before = thread_allocation_count;
+					render_tile(t, world, lights, accum);
+					allocations.fetch_add(thread_allocation_count - allocations_before, std::memory_order_relaxed);
+					progress.tile_done(ray_counter);
+				});
+				active = active_pixels(accum);
+
+				auto now = std::chrono::steady_clock::now();
+				if (time_limit > 0 && std::chrono::duration<double>(now - start).count() >= time_limit)
+					active = 0;
+				bool finished = active == 0;
+				bool due = std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval;
+				if (!checkpoint_path.empty() && (finished || due)) {
+					if (!accum.save(checkpoint_path))
+						std::cerr << "ERROR: Could not write checkpoint '" << checkpoint_path << "'.\n";
+					if (!finished && !output_path.empty())
+						write_resolved(accum);
+					last_checkpoint = now;
 				}
 			}
+			progress.finish();
+
+			write_resolved(accum);
+			report_samples(accum);
+
+			render_stats stats;
+			stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			stats.samples_per_pixel = double(accum.total_samples()) / (size_t(image_width) * image_height);
+			stats.relative_error = accum.image_relative_error();
+			std::clog << "Relative error: " << stats.relative_error << " after " << stats.seconds << " s\n";
+
+			//Every traced ray is one path segment
+			auto paths = accum.total_samples() - samples_before;
+			if (paths > 0) {
+				std::clog << "Average path length: " << double(progress.rays()) / paths << " segments\n";
+				if (allocation_counting())
+					std::clog << "Heap allocations per sample: " << double(allocations.load()) / paths << '\n';
+			}
+			if (!heatmap_path.empty())
+				write_heatmap(accum);
 
-			std::clog << "\rDone.                 \n";
+			std::clog << "Done.\n";
+			return stats;
 		}
 
 	private:
 		int    image_height;
-		double pixel_samples_scale;
 		int sqrt_spp;
 		double recip_sqrt_spp;
+		int sample_limit; //Samples per pixel at most
+		int pass_size;    //Samples per pixel per pass
 		point3 center;
 		point3 pixel00_loc;
 		vec3   pixel_delta_u;
@@ -59,15 +174,33 @@ class camera {
 		vec3   defocus_disk_u;
 		vec3   defocus_disk_v;
 
+		static inline thread_local std::uint64_t ray_counter = 0; //Rays traced by the current thread
+
+		//Light sample whose shadow segment must be unoccluded over [0, 1] for emitted to arrive
+		struct light_query {
+			color emitted = color(0, 0, 0);
+			bool needs_test = false;
+			ray segment;
+		};
+
+		//First-vertex light sample left to the packet path, contribution counts if segment is unoccluded
+		struct shadow_query {
+			bool pending = false;
+			ray segment;
+			color contribution;
+		};
+
 		//Initiatlizes Camera
 		void initialize() {
 			image_height = int(image_width / aspect_ratio);
 			image_height = (image_height < 1) ? 1 : image_height;
 
 			sqrt_spp = int(std::sqrt(samples_per_pixel));
-			pixel_samples_scale = 1.0 / (sqrt_spp * sqrt_spp);
 			recip_sqrt_spp = 1.0 / sqrt_spp;
 
+			sample_limit = adaptive_sampling ? std::max(max_samples, 1) : sqrt_spp * sqrt_spp;
+			pass_size = samples_per_pass > 0 ? samples_per_pass : sample_limit;
+
 			center = lookfrom;
 
 			//Viewport Calculations
@@ -100,8 +233,207 @@ class camera {
 
 		}
 
-		ray get_ray(int i, int j, int s_i, int s_j) const {
-			auto offset = sample_square_stratified(s_i, s_j);
+		void resume_from_checkpoint(accumulation_buffer& accum) const {
+			accumulation_buffer saved;
+			if (!saved.load(checkpoint_path))
+				return;
+
+			if (saved.width() != image_width || saved.height() != image_height || saved.seed != seed || saved.sample_grid != accum.sample_grid) {
+				std::clog << "Checkpoint '" << checkpoint_path << "' is for another image, seed or sample count, starting over\n";
+				return;
+			}
+
+			accum = saved;
+			std::clog << "Resuming from " << double(accum.total_samples()) / (size_t(image_width) * image_height) << " samples per pixel\n";
+		}
+
+		//Samples pixel (i, j) takes in the next pass, 0 once it is done
+		int pass_samples(const accumulation_buffer& accum, int i, int j) const {
+			int n = int(accum.count(i, j));
+			if (n >= sample_limit)
+				return 0;
+			if (!adaptive_sampling)
+				return std::min(pass_size, sample_limit - n);
+
+			if (n >= min_samples && accum.relative_error(i, j) <= target_error)
+				return 0;
+			return std::min(std::max(pass_size, min_samples - n), sample_limit - n);
+		}
+
+		size_t active_pixels(const accumulation_buffer& accum) const {
+			size_t active = 0;
+			for (int j = 0; j < image_height; j++)
+				for (int i = 0; i < image_width; i++)
+					active += pass_samples(accum, i, j) > 0;
+			return active;
+		}
+
+		void report_samples(const accumulation_buffer& accum) const {
+			std::uint32_t fewest = ~0u, most = 0;
+			for (int j = 0; j < image_height; j++) {
+				for (int i = 0; i < image_width; i++) {
+					fewest = std::min(fewest, accum.count(i, j));
+					most = std::max(most, accum.count(i, j));
+				}
+			}
+			auto mean = double(accum.total_samples()) / (size_t(image_width) * image_height);
+			std::clog << "Samples per pixel: min " << fewest << ", mean " << mean << ", max " << most << '\n';
+		}
+
+		//Sample counts relative to the largest on a blue-green-red ramp, squared to undo the writer's gamma
+		void write_heatmap(const accumulation_buffer& accum) const {
+			std::uint32_t most = 1;
+			for (int j = 0; j < image_height; j++)
+				for (int i = 0; i < image_width; i++)
+					most = std::max(most, accum.count(i, j));
+
+			static const interval unit(0, 1);
+			framebuffer heatmap(image_width, image_height);
+			for (int j = 0; j < image_height; j++) {
+				for (int i = 0; i < image_width; i++) {
+					auto t = double(accum.count(i, j)) / most;
+					auto r = unit.clamp(1.5 - std::fabs(4 * t - 3));
+					auto g = unit.clamp(1.5 - std::fabs(4 * t - 2));
+					auto b = unit.clamp(1.5 - std::fabs(4 * t - 1));
+					heatmap.set(i, j, color(r * r, g * g, b * b));
+				}
+			}
+			write_image(heatmap, heatmap_path);
+		}
+
+		void write_resolved(const accumulation_buffer& accum) const {
+			framebuffer image(image_width, image_height);
+			accum.resolve(image);
+			write_image(image, output_path, output_format);
+		}
+
+		//A pixel's samples continue from its count. Sample index s seeds the generator, so any split
+		//into passes gives the same samples
+		void render_tile(const tile& t, const hittable& world, const hittable& lights, accumulation_buffer& accum) const {
+			auto packet_world = packet_tracing ? dynamic_cast<const flat_bvh*>(&world) : nullptr;
+			if (packet_world) {
+				render_tile_packets(t, *packet_world, lights, accum);
+				return;
+			}
+
+			for (int j = t.y0; j < t.y1; j++) {
+				for (int i = t.x0; i < t.x1; i++) {
+					auto pixel_index = std::uint64_t(j) * image_width + i;
+					int first_sample = int(accum.count(i, j));
+					int last_sample = first_sample + pass_samples(accum, i, j);
+
+					color pixel_color(0, 0, 0);
+					luminance_stats stats;
+					for (int s = first_sample; s < last_sample; s++) {
+						seed_thread_rng(seed, pixel_index, s);
+						auto sample = ray_color(sample_ray(i, j, s), world, lights);
+						pixel_color += sample;
+						stats.add(luminance(sample));
+					}
+
+					accum.add(i, j, pixel_color, stats);
+				}
+			}
+		}
+
+		/* Packet Path
+		*
+		* Each sample of a 4x4 pixel block is one 16-ray packet of coherent camera rays.
+		* Lanes are seeded exactly like the single-ray path and their generator state is
+		* restored before shading, so both paths take the same samples. Bounces are
+		* incoherent and continue one ray at a time. With nee_mis the shadow rays of the
+		* first vertices start close together toward the same lights, so shading only
+		* records them (shadow_query) and they are tested afterwards as one occlusion packet.
+		*/
+		void render_tile_packets(const tile& t, const flat_bvh& world, const hittable& lights, accumulation_buffer& accum) const {
+			constexpr int block = 4;
+			constexpr int lanes = block * block;
+
+			for (int by = t.y0; by < t.y1; by += block) {
+				for (int bx = t.x0; bx < t.x1; bx += block) {
+					color block_color[lanes];
+					luminance_stats block_stats[lanes];
+					int first_sample[lanes] = {};
+					int lane_samples[lanes] = {};
+					int block_samples = 0;
+
+					for (int lane = 0; lane < lanes; lane++) {
+						int i = bx + lane % block;
+						int j = by + lane / block;
+						if (i >= t.x1 || j >= t.y1)
+							continue;
+
+						first_sample[lane] = int(accum.count(i, j));
+						lane_samples[lane] = pass_samples(accum, i, j);
+						block_samples = std::max(block_samples, lane_samples[lane]);
+					}
+
+					//Packet k holds sample first_sample + k of every lane that still takes one
+					for (int k = 0; k < block_samples; k++) {
+						color samples[lanes];
+						shadow_query shadows[lanes];
+						ray_packet<lanes> packet;
+						rng lane_rng[lanes];
+
+						for (int lane = 0; lane < lanes; lane++) {
+							if (k >= lane_samples[lane])
+								continue;
+
+							int i = bx + lane % block;
+							int j = by + lane / block;
+							int s = first_sample[lane] + k;
+							seed_thread_rng(seed, std::uint64_t(j) * image_width + i, s);
+							packet.set(lane, sample_ray(i, j, s), interval(0, infinity));
+							lane_rng[lane] = thread_rng();
+						}
+
+						auto active = packet.active;
+						hit_record recs[lanes];
+						auto hits = world.hit_packet(packet, recs);
+
+						ray_packet<lanes> shadow_packet;
+						for (int lane = 0; lane < lanes; lane++) {
+							if (!(active & (1u << lane)) || max_depth <= 0)
+								continue;
+
+							thread_rng() = lane_rng[lane];
+							ray_counter++;
+							samples[lane] = (hits & (1u << lane))
+								? shade(packet.rays[lane], recs[lane], world, lights, &shadows[lane])
+								: background;
+							if (shadows[lane].pending)
+								shadow_packet.set(lane, shadows[lane].segment, interval(0, 1));
+						}
+
+						auto blocked = shadow_packet.active ? world.occluded_packet(shadow_packet) : 0u;
+						for (int lane = 0; lane < lanes; lane++) {
+							if (!(active & (1u << lane)))
+								continue;
+
+							if (shadows[lane].pending && !(blocked & (1u << lane)))
+								samples[lane] += shadows[lane].contribution;
+							block_color[lane] += samples[lane];
+							block_stats[lane].add(luminance(samples[lane]));
+						}
+					}
+
+					for (int lane = 0; lane < lanes; lane++) {
+						int i = bx + lane % block;
+						int j = by + lane / block;
+						if (i < t.x1 && j < t.y1)
+							accum.add(i, j, block_color[lane], block_stats[lane]);
+					}
+				}
+			}
+		}
+
+		//Stratum (s % sqrt_spp, s / sqrt_spp) for uniform renders, jittered over the pixel when adaptive
+		ray sample_ray(int i, int j, int s) const {
+			auto offset = adaptive_sampling ? sample_square() : sample_square_stratified(s % sqrt_spp, s / sqrt_spp);
+			return get_ray(i, j, offset);
+		}
+
+		ray get_ray(int i, int j, const vec3& offset) const {
 			auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v);
 			auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
 			auto ray_direction = pixel_sample - ray_origin;
@@ -127,41 +459,205 @@ class camera {
 		}
 
 		//Ray Color Alg
-		color ray_color(const ray& r, int depth, const hittable& world, const hittable& lights)
-			const {
+		color ray_color(const ray& r, const hittable& world, const hittable& lights) const {
 			// Ray Bounce Limit
-			if (depth <= 0)
+			if (max_depth <= 0)
 				return color(0, 0, 0);
 
+			ray_counter++;
 			hit_record rec;
 
 			// No intersect
-			if (!world.hit(r, interval(0.001, infinity), rec))
+			if (!world.hit(r, interval(0, infinity), rec))
 				return background;
 
-			scatter_record srec;
-			color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+			return shade(r, rec, world, lights);
+		}
+
+		/* Path Tracer
+		*
+		* Follows the path from its first intersection (shared with the packet path) one
+		* segment at a time, carrying the product of attenuation * pdf ratios as throughput.
+		* From rr_min_depth segments on, Russian roulette continues a path with probability
+		* equal to its largest throughput channel and divides survivors by that probability,
+		* so the estimate stays unbiased. max_depth still caps every path. Each segment
+		* starts at hit_record::spawn_origin() off the surface it leaves and is traced from t = 0.
+		*/
+		color shade(ray r, hit_record rec, const hittable& world, const hittable& lights, shadow_query* first_shadow = nullptr) const {
+			if (path_integrator == integrator::nee_mis)
+				return shade_nee_mis(r, rec, world, lights, first_shadow);
+
+			color radiance(0, 0, 0);
+			color throughput(1, 1, 1);
+
+			for (int segments = 1; ; segments++) {
+				radiance += throughput * rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+
+				scatter_record srec;
+				if (segments >= max_depth || !rec.mat->scatter(r, rec, srec))
+					break;
+
+				if (srec.skip_pdf) {
+					throughput = throughput * srec.attenuation;
+					r = srec.skip_pdf_ray;
+				}
+				else {
+					//Drawn and evaluated from the spawn origin on the side the surface scatters into
+					auto origin = rec.spawn_origin(rec.normal);
+					mixture_pdf p(hittable_pdf(lights, origin), srec.scatter_pdf);
+
+					ray scattered = ray(origin, p.generate(), r.time());
+					auto pdf_value = p.value(scattered.direction());
+					if (!(pdf_value > 0))
+						break;
+					double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+					throughput = throughput * srec.attenuation * scattering_pdf / pdf_value;
+					r = scattered;
+				}
 
-			if (!rec.mat->scatter(r, rec, srec))
-				return color_from_emission;
+				if (segments >= rr_min_depth) {
+					auto survive = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 1.0);
+					if (random_double() >= survive)
+						break;
+					throughput /= survive;
+				}
 
-			if (srec.skip_pdf) {
-				return srec.attenuation * ray_color(srec.skip_pdf_ray, depth - 1, world, lights);
+				r = ray(rec.spawn_origin(r.direction()), r.direction(), r.time());
+				ray_counter++;
+				if (!world.hit(r, interval(0, infinity), rec)) {
+					radiance += throughput * background;
+					break;
+				}
 			}
 
-			auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-			mixture_pdf p(light_ptr, srec.pdf_ptr);
+			return radiance;
+		}
+
+		/* Next-Event Estimation
+		*
+		* At every diffuse vertex a light direction is sampled and its shadow ray traced, the
+		* light contributes if nothing blocks it (light_sample()). The path then continues
+		* along a BSDF sample, and emission that sample happens to hit is counted again.
+		* Both strategies can produce the same light path, so each is weighted by the power
+		* heuristic against the other's pdf for that direction (Veach's MIS). The BSDF hit
+		* needs the light pdf as seen from the previous vertex, so that vertex and the BSDF
+		* pdf are carried along. Camera rays and specular (skip_pdf) bounces have no light
+		* sample competing and take emission at full weight. Throughput, Russian roulette
+		* and spawn origins work as in shade(). Given first_shadow, the visibility test of
+		* the first vertex's light sample is left to the caller there instead of traced.
+		*/
+		color shade_nee_mis(ray r, hit_record rec, const hittable& world, const hittable& lights, shadow_query* first_shadow = nullptr) const {
+			color radiance(0, 0, 0);
+			color throughput(1, 1, 1);
+			bool specular = true;   //Emission reached by the last segment is not also found by a light sample
+			double bsdf_pdf = 0;    //pdf of the last segment's direction
+			point3 previous;        //Spawn origin of the last segment
+
+			for (int segments = 1; ; segments++) {
+				auto emitted = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+				if (specular)
+					radiance += throughput * emitted;
+				else if (emitted.x() > 0 || emitted.y() > 0 || emitted.z() > 0)
+					radiance += throughput * emitted * power_heuristic(bsdf_pdf, lights.pdf_value(previous, r.direction()));
+
+				scatter_record srec;
+				if (segments >= max_depth || !rec.mat->scatter(r, rec, srec))
+					break;
+
+				if (srec.skip_pdf) {
+					throughput = throughput * srec.attenuation;
+					r = srec.skip_pdf_ray;
+					specular = true;
+				}
+				else {
+					//Light sample, drawn and evaluated from the spawn origin on the side the surface scatters
+					//into. Directions the surface doesn't scatter into (behind it) skip the shadow ray
+					auto origin = rec.spawn_origin(rec.normal);
+					auto to_light = lights.random(origin);
+					ray shadow(origin, to_light, r.time());
+					auto scattering = rec.mat->scattering_pdf(r, rec, shadow);
+					auto light_pdf = scattering > 0 ? lights.pdf_value(origin, to_light) : 0.0;
+					if (light_pdf > 0) {
+						auto light = light_sample(shadow, world, lights);
+						if (light.emitted.x() > 0 || light.emitted.y() > 0 || light.emitted.z() > 0) {
+							auto weight = power_heuristic(light_pdf, srec.scatter_pdf.value(to_light));
+							auto contribution = throughput * srec.attenuation * light.emitted * (scattering * weight / light_pdf);
+							if (light.needs_test && first_shadow && segments == 1)
+								*first_shadow = { true, light.segment, contribution };
+							else if (!light.needs_test || !world.occluded(light.segment, interval(0, 1)))
+								radiance += contribution;
+						}
+					}
+
+					//BSDF sample continues the path
+					ray scattered = ray(origin, srec.scatter_pdf.generate(), r.time());
+					bsdf_pdf = srec.scatter_pdf.value(scattered.direction());
+					if (!(bsdf_pdf > 0))
+						break;
+					double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+					throughput = throughput * srec.attenuation * scattering_pdf / bsdf_pdf;
+					r = scattered;
+					previous = origin;
+					specular = false;
+				}
 
-			ray scattered = ray(rec.p, p.generate(), r.time());
-			auto pdf_value = p.value(scattered.direction());
+				if (segments >= rr_min_depth) {
+					auto survive = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 1.0);
+					if (random_double() >= survive)
+						break;
+					throughput /= survive;
+				}
 
-			double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+				r = ray(rec.spawn_origin(r.direction()), r.direction(), r.time());
+				ray_counter++;
+				if (!world.hit(r, interval(0, infinity), rec)) {
+					radiance += throughput * background;
+					break;
+				}
+			}
 
-			color sample_color = ray_color(scattered, depth - 1, world, lights);
-			color color_from_scatter =
-				(srec.attenuation * scattering_pdf * sample_color) / pdf_value;
+			return radiance;
+		}
+
+		/* Shadow Ray
+		*
+		* Radiance arriving along shadow from the nearest light in its direction. A light
+		* that carries its material (the same emitter as its copy in the world) gives the
+		* emission directly, and only an any-hit occluded() query decides visibility, on a
+		* segment that ends just in front of the light (its spawn origin toward the shading
+		* point) so the light itself can't block it. Lights listed only as sampling targets
+		* (no material) fall back to a closest hit on the world, whose first surface then
+		* has to emit. The occlusion test is left to the caller (needs_test), so it can be
+		* traced alone or in a packet.
+		*/
+		light_query light_sample(const ray& shadow, const hittable& world, const hittable& lights) const {
+			light_query query;
+			hit_record light_rec;
+			if (!lights.hit(shadow, interval(0, infinity), light_rec))
+				return query;
+
+			if (light_rec.mat) {
+				query.emitted = light_rec.mat->emitted(shadow, light_rec, light_rec.u, light_rec.v, light_rec.p);
+				if (query.emitted.x() <= 0 && query.emitted.y() <= 0 && query.emitted.z() <= 0)
+					return query;
+
+				auto target = light_rec.spawn_origin(shadow.origin() - light_rec.p);
+				query.segment = ray(shadow.origin(), target - shadow.origin(), shadow.time());
+				query.needs_test = true;
+				return query;
+			}
+
+			if (world.hit(shadow, interval(0, infinity), light_rec))
+				query.emitted = light_rec.mat->emitted(shadow, light_rec, light_rec.u, light_rec.v, light_rec.p);
+			return query;
+		}
 
-			return color_from_emission + color_from_scatter;
+		static double power_heuristic(double pdf, double other_pdf) {
+			auto a = pdf * pdf;
+			auto b = other_pdf * other_pdf;
+			return a / (a + b);
 		}
 };
 
@@ -4,6 +4,7 @@
 #include "interval.h"
 #include "vec3.h"
 #include "utility.h"
+#include "simd.h"
 
 using color = vec3;
 
@@ -14,26 +15,44 @@ inline double linear_to_gamma(double linear_component) { //Linear to Gamma space
 	return 0;
 }
 
-void write_color(std::ostream& out, color& pixel_color) {
-	auto r = pixel_color.x();
-	auto g = pixel_color.y();
-	auto b = pixel_color.z();
-
-	if (r != r) r = 0.0;
-	if (g != g) g = 0.0;
-	if (b != b) b = 0.0;
+//Rec. 709 luminance of a linear color
+inline double luminance(const color& c) {
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
 
-	r = linear_to_gamma(r);
-	g = linear_to_gamma(g);
-	b = linear_to_gamma(b);
+/* Linear floats to display bytes for a whole buffer
+*
+* NaN -> 0, gamma 2 (sqrt), clamp to [0, 0.999], scale to [0, 255]. The SSE path
+* converts four channels per iteration, max(x, 0) also maps NaN to 0 there.
+*/
+SRT_TARGET_SSE
+inline void linear_to_gamma_bytes(const float* linear, unsigned char* bytes, size_t count) {
+	size_t k = 0;
+
+#ifdef SRT_X86
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(0.999f);
+	const __m128 scale = _mm_set1_ps(256.0f);
+
+	for (; k + 16 <= count; k += 16) {
+		__m128i quads[4];
+		for (int q = 0; q < 4; q++) {
+			__m128 x = _mm_max_ps(_mm_loadu_ps(linear + k + 4 * q), zero);
+			x = _mm_min_ps(_mm_sqrt_ps(x), one);
+			quads[q] = _mm_cvttps_epi32(_mm_mul_ps(x, scale));
+		}
+		__m128i words = _mm_packs_epi32(quads[0], quads[1]);
+		__m128i words_hi = _mm_packs_epi32(quads[2], quads[3]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + k), _mm_packus_epi16(words, words_hi));
+	}
+#endif
 
-	//Translation
 	static const interval intensity(0.000, 0.999);
-	int rbyte = int(256 * intensity.clamp(r));
-	int gbyte = int(256 * intensity.clamp(g));
-	int bbyte = int(256 * intensity.clamp(b));
-
-	out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+	for (; k < count; k++) {
+		double x = linear[k];
+		if (x != x) x = 0.0;
+		bytes[k] = (unsigned char)(256 * intensity.clamp(linear_to_gamma(x)));
+	}
 }
 
 #endif
\ No newline at end of file
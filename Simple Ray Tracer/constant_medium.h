@@ -9,17 +9,47 @@ class constant_medium : public hittable {
 public:
     constant_medium(shared_ptr<hittable> boundary, double density, shared_ptr<texture> tex)
         : boundary(boundary), neg_inv_density(-1 / density),
-        phase_function(make_shared<isotropic>(tex))
+        phase_function(tex)
     {
     }
 
     constant_medium(shared_ptr<hittable> boundary, double density, const color& albedo)
         : boundary(boundary), neg_inv_density(-1 / density),
-        phase_function(make_shared<isotropic>(albedo))
+        phase_function(albedo)
     {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        real t;
+        if (!scatter_distance(r, ray_t, t))
+            return false;
+
+        rec.s = t;
+        rec.p = r.at(rec.s);
+        rec.p_error = 0; //Inside the volume, there is no surface to step off
+
+        rec.normal = vec3(1, 0, 0);
+        rec.front_face = true;
+        rec.mat = &phase_function;
+
+        return true;
+    }
+
+    //Blocked when the ray scatters inside ray_t, drawn exactly like hit()
+    bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        return scatter_distance(r, ray_t, t);
+    }
+
+    aabb bounding_box() const override { return boundary->bounding_box(); }
+
+private:
+    shared_ptr<hittable> boundary;
+    double neg_inv_density;
+    isotropic phase_function; //Owned by the medium itself
+
+    //Samples where the ray scatters inside the boundary, false if it passes through ray_t
+    bool scatter_distance(const ray& r, interval ray_t, real& t) const {
         hit_record rec1, rec2;
 
         if (!boundary->hit(r, interval::universe, rec1))
@@ -44,22 +74,9 @@ public:
         if (hit_distance > distance_inside_boundary)
             return false;
 
-        rec.s = rec1.s + hit_distance / ray_length;
-        rec.p = r.at(rec.s);
-
-        rec.normal = vec3(1, 0, 0);
-        rec.front_face = true;
-        rec.mat = phase_function;
-
+        t = rec1.s + hit_distance / ray_length;
         return true;
     }
-
-    aabb bounding_box() const override { return boundary->bounding_box(); }
-
-private:
-    shared_ptr<hittable> boundary;
-    double neg_inv_density;
-    shared_ptr<material> phase_function;
 };
 
 #endif
\ No newline at end of file
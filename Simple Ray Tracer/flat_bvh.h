@@ -0,0 +1,248 @@
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "bvh_builder.h"
+#include "flat_bvh_node.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "ray_packet.h"
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+/* Flattened BVH
+*
+* A compiled form of bvh_node: all nodes live in one contiguous array in depth-first
+* order and leaves index into a primitive array. hit() walks it with a fixed stack,
+* nearest child first, without recursion, virtual node calls or refcount traffic.
+* Bounds are stored as floats rounded outwards, so they never shrink.
+*/
+class flat_bvh : public hittable {
+	public:
+		//Builds the tree with bvh_builder on thread_count threads (0 -> all cores), list must not be empty
+		flat_bvh(const hittable_list& list, bvh_split split = bvh_split::sah, int thread_count = 0)
+			: flat_bvh(*build_bvh(list, split, thread_count)) {}
+
+		flat_bvh(const bvh_node& tree) : bbox(tree.bounding_box()) {
+			flatten(tree, 1);
+
+			//Pathologically unbalanced trees would overflow the traversal stack, median splits cannot
+			if (max_depth >= max_stack) {
+				auto objects = owned;
+				nodes.clear();
+				owned.clear();
+				primitives.clear();
+				max_depth = 0;
+				flatten(bvh_node(objects, 0, objects.size(), bvh_split::median), 1);
+			}
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			return traverse<false>(r, ray_t, rec);
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			hit_record unused;
+			return traverse<true>(r, ray_t, unused);
+		}
+
+		//Closest hit for every active lane, returns the mask of lanes that hit (their recs are filled)
+		template <int N>
+		std::uint32_t hit_packet(ray_packet<N>& packet, hit_record* recs) const {
+			return traverse(packet, recs, false);
+		}
+
+		//Any hit for every active lane, returns the mask of lanes that are blocked
+		template <int N>
+		std::uint32_t occluded_packet(ray_packet<N>& packet) const {
+			hit_record recs[N];
+			return traverse(packet, recs, true);
+		}
+
+		aabb bounding_box() const override { return bbox; }
+
+		size_t node_count() const { return nodes.size(); }
+		size_t primitive_count() const { return primitives.size(); }
+
+	private:
+		static constexpr int max_stack = 64;
+
+		std::vector<flat_bvh_node> nodes;
+		std::vector<const hittable*> primitives;  //Leaf order, referenced by flat_bvh_node::offset
+		std::vector<shared_ptr<hittable>> owned;  //Keeps the primitives alive, never touched while tracing
+		aabb bbox;
+		int max_depth = 0;
+
+		//Single ray walk, any_hit returns at the first primitive that blocks ray_t and leaves rec alone
+		template <bool any_hit>
+		bool traverse(const ray& r, interval ray_t, hit_record& rec) const {
+			const point3& orig = r.origin();
+			const vec3& dir = r.direction();
+			const double inv_dir[3] = { 1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2] };
+			const bool dir_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+			std::uint32_t stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+			bool hit_anything = false;
+
+			while (true) {
+				const flat_bvh_node& node = nodes[current];
+
+				if (slab_hit(node, orig, inv_dir, ray_t)) {
+					if (node.count > 0) {
+						for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+							if constexpr (any_hit) {
+								if (primitives[i]->occluded(r, ray_t))
+									return true;
+							}
+							else if (primitives[i]->hit(r, ray_t, rec)) {
+								hit_anything = true;
+								ray_t.max = rec.s;
+							}
+						}
+					}
+					else {
+						//Descend into the child on the ray's side of the split, defer the other
+						if (dir_negative[node.axis]) {
+							stack[stack_size++] = current + 1;
+							current = node.offset;
+						}
+						else {
+							stack[stack_size++] = node.offset;
+							current = current + 1;
+						}
+						continue;
+					}
+				}
+
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+
+			return hit_anything;
+		}
+
+		//Packet form of hit(): each stack entry carries the lanes still inside that subtree
+		template <int N>
+		std::uint32_t traverse(ray_packet<N>& packet, hit_record* recs, bool any_hit) const {
+			int lead = packet.leader();
+			const bool dir_negative[3] = {
+				packet.inv_dir[0][lead] < 0, packet.inv_dir[1][lead] < 0, packet.inv_dir[2][lead] < 0
+			};
+
+			struct entry {
+				std::uint32_t node;
+				std::uint32_t mask;
+			};
+
+			entry stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+			std::uint32_t mask = packet.active;
+			std::uint32_t hits = 0;
+
+			while (true) {
+				const flat_bvh_node& node = nodes[current];
+				mask = packet.slab_test(node.min, node.max, mask & packet.active);
+
+				if (mask) {
+					if (node.count > 0) {
+						for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+							for (int lane = 0; lane < N; lane++) {
+								if (!(mask & (1u << lane)))
+									continue;
+
+								interval ray_t(packet.t_min[lane], packet.t_max[lane]);
+								bool blocked = any_hit ? primitives[i]->occluded(packet.rays[lane], ray_t)
+									: primitives[i]->hit(packet.rays[lane], ray_t, recs[lane]);
+								if (blocked) {
+									hits |= 1u << lane;
+									if (any_hit) {
+										packet.active &= ~(1u << lane);
+										mask &= ~(1u << lane);
+									}
+									else {
+										packet.t_max[lane] = recs[lane].s;
+									}
+								}
+							}
+						}
+					}
+					else {
+						std::uint32_t near_child = current + 1;
+						std::uint32_t far_child = node.offset;
+						if (dir_negative[node.axis])
+							std::swap(near_child, far_child);
+
+						stack[stack_size++] = { far_child, mask };
+						current = near_child;
+						continue;
+					}
+				}
+
+				if (stack_size == 0 || !packet.active)
+					break;
+				stack_size--;
+				current = stack[stack_size].node;
+				mask = stack[stack_size].mask;
+			}
+
+			return hits;
+		}
+
+		//Appends the subtree rooted at node in depth-first order and returns its node index
+		std::uint32_t flatten(const bvh_node& node, int depth) {
+			max_depth = depth > max_depth ? depth : max_depth;
+
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+			set_bounds(nodes[index], node.bounding_box());
+
+			const auto& left = node.left_child();
+			const auto& right = node.right_child();
+			bool left_is_node = dynamic_cast<const bvh_node*>(left.get()) != nullptr;
+			bool right_is_node = dynamic_cast<const bvh_node*>(right.get()) != nullptr;
+
+			//Two primitive children become a single leaf (one if bvh_node duplicated a lone object)
+			if (!left_is_node && !right_is_node) {
+				if (left == right)
+					make_leaf(index, { left.get() }, { left });
+				else
+					make_leaf(index, { left.get(), right.get() }, { left, right });
+				return index;
+			}
+
+			nodes[index].axis = std::uint8_t(split_axis(left->bounding_box(), right->bounding_box()));
+
+			flatten_child(left, depth + 1);
+			auto second = flatten_child(right, depth + 1);
+			nodes[index].offset = second;
+			return index;
+		}
+
+		std::uint32_t flatten_child(const shared_ptr<hittable>& child, int depth) {
+			if (auto node = dynamic_cast<const bvh_node*>(child.get()))
+				return flatten(*node, depth);
+
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+			set_bounds(nodes[index], child->bounding_box());
+			make_leaf(index, { child.get() }, { child });
+			return index;
+		}
+
+		void make_leaf(std::uint32_t index, std::initializer_list<const hittable*> objects,
+			std::initializer_list<shared_ptr<hittable>> owners) {
+			nodes[index].offset = std::uint32_t(primitives.size());
+			nodes[index].count = std::uint16_t(objects.size());
+			primitives.insert(primitives.end(), objects);
+			owned.insert(owned.end(), owners);
+		}
+};
+
+#endif
\ No newline at end of file
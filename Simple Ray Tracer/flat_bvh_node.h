@@ -0,0 +1,78 @@
+#ifndef FLAT_BVH_NODE_H
+#define FLAT_BVH_NODE_H
+
+#include "aabb.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+//One 32-byte node of a flat_bvh, two per 64-byte cache line
+struct alignas(32) flat_bvh_node {
+	float min[3];
+	float max[3];
+	std::uint32_t offset; //Leaf: first primitive index, Interior: index of the second child (the first child follows directly)
+	std::uint16_t count;  //Primitive count, 0 for interior nodes
+	std::uint8_t axis;    //Interior split axis, decides which child a ray visits first
+	std::uint8_t pad;
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node must stay 32 bytes");
+
+/* Float Node Helpers
+*
+* Shared by the BVH layouts that store their bounds as floats (flat_bvh, soa_bvh,
+* wide_bvh, triangle_mesh). Bounds are rounded outwards so they never shrink.
+*/
+
+inline float round_down(double x) {
+	auto f = float(x);
+	return double(f) > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float round_up(double x) {
+	auto f = float(x);
+	return double(f) < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+inline void set_bounds(flat_bvh_node& node, const aabb& box) {
+	for (int axis = 0; axis < 3; axis++) {
+		const interval& ax = box.axis_interval(axis);
+		node.min[axis] = round_down(ax.min);
+		node.max[axis] = round_up(ax.max);
+	}
+}
+
+//Axis along which the child centroids are furthest apart
+inline int split_axis(const aabb& a, const aabb& b) {
+	auto delta = a.centroid() - b.centroid();
+	int axis = 0;
+	for (int i = 1; i < 3; i++)
+		if (std::fabs(delta[i]) > std::fabs(delta[axis]))
+			axis = i;
+	return axis;
+}
+
+//Slab test in double against the node's float box. The range stays double too, so a float
+//build never rounds a distance inwards, and a box touching the ray in one point still counts
+inline bool slab_hit(const flat_bvh_node& node, const point3& orig, const double* inv_dir, interval ray_t) {
+	double t_min = ray_t.min;
+	double t_max = ray_t.max;
+	for (int axis = 0; axis < 3; axis++) {
+		auto t0 = (double(node.min[axis]) - orig[axis]) * inv_dir[axis];
+		auto t1 = (double(node.max[axis]) - orig[axis]) * inv_dir[axis];
+
+		if (inv_dir[axis] < 0)
+			std::swap(t0, t1);
+
+		t_min = t0 > t_min ? t0 : t_min;
+		t_max = t1 < t_max ? t1 : t_max;
+
+		if (t_max < t_min)
+			return false;
+	}
+	return true;
+}
+
+#endif
\ No newline at end of file
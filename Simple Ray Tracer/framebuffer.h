@@ -0,0 +1,46 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "utility.h"
+
+#include <vector>
+
+//Linear HDR image, RGB float triples stored row by row from the top
+class framebuffer {
+	public:
+		framebuffer() {}
+		framebuffer(int width, int height) : image_width(width), image_height(height), pixels(size_t(width) * height * 3, 0.0f) {}
+
+		int width() const { return image_width; }
+		int height() const { return image_height; }
+
+		void set(int i, int j, const color& c) {
+			float* p = &pixels[(size_t(j) * image_width + i) * 3];
+			p[0] = float(c.x());
+			p[1] = float(c.y());
+			p[2] = float(c.z());
+		}
+
+		color get(int i, int j) const {
+			const float* p = &pixels[(size_t(j) * image_width + i) * 3];
+			return color(p[0], p[1], p[2]);
+		}
+
+		const float* data() const { return pixels.data(); }
+		float* data() { return pixels.data(); }
+		size_t channel_count() const { return pixels.size(); }
+
+		//Gamma-encoded, clamped 8-bit RGB of the whole buffer
+		std::vector<unsigned char> to_bytes() const {
+			std::vector<unsigned char> bytes(pixels.size());
+			linear_to_gamma_bytes(pixels.data(), bytes.data(), pixels.size());
+			return bytes;
+		}
+
+	private:
+		int image_width = 0;
+		int image_height = 0;
+		std::vector<float> pixels;
+};
+
+#endif
\ No newline at end of file
@@ -3,17 +3,19 @@
 
 #include "utility.h"
 #include "aabb.h"
+#include "affine.h"
 
 class material;
 
 class hit_record {
 	public:
 		point3 p;
+		real p_error; //Bound on the rounding error of each coordinate of p, set wherever p is
 		vec3 normal;
-		shared_ptr<material> mat;
-		double s;
-		double u;
-		double v;
+		const material* mat; //Owned by the scene (scene::add_material), outlives every render of it
+		real s;
+		real u;
+		real v;
 		bool front_face;
 
 		//Set the normal direction based on the ray direction (outside vs inside)
@@ -21,6 +23,23 @@ class hit_record {
 			front_face = dot(r.direction(), outward_normal) < 0; //True -> ray is outside, False -> ray is inside
 			normal = front_face ? outward_normal : -outward_normal;
 		}
+
+		//Origin for a ray leaving p in direction: p moved along the normal, to the side the ray
+		//leaves on, past its error bound and rounded away from the surface, so the ray can be
+		//traced from t = 0 without hitting the surface it starts on (no fixed epsilon to tune)
+		point3 spawn_origin(const vec3& direction) const {
+			auto distance = p_error * (std::fabs(normal.x()) + std::fabs(normal.y()) + std::fabs(normal.z()));
+			vec3 offset = dot(direction, normal) < 0 ? -distance * normal : distance * normal;
+
+			point3 origin = p + offset;
+			for (int axis = 0; axis < 3; axis++) {
+				if (offset[axis] > 0)
+					origin[axis] = std::nextafter(origin[axis], std::numeric_limits<real>::infinity());
+				else if (offset[axis] < 0)
+					origin[axis] = std::nextafter(origin[axis], -std::numeric_limits<real>::infinity());
+			}
+			return origin;
+		}
 };
 
 class hittable {
@@ -28,6 +47,13 @@ class hittable {
 		virtual ~hittable() = default; //Deconstructor
 		
 		virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+		//Any hit inside ray_t, for visibility tests. Overrides stop at the first hit found and
+		//skip the hit record, this fallback keeps hittables that don't override it working
+		virtual bool occluded(const ray& r, interval ray_t) const {
+			hit_record rec;
+			return hit(r, ray_t, rec);
+		}
 		
 		virtual aabb bounding_box() const = 0;
 		
@@ -38,107 +64,117 @@ class hittable {
 		virtual vec3 random(const point3& origin) const {
 			return vec3(1, 0, 0);
 		}
+
+		//For weighting lights by power (light_sampler.h), 0 / nullptr when unknown
+		virtual double surface_area() const {
+			return 0.0;
+		}
+
+		virtual const material* surface_material() const {
+			return nullptr;
+		}
 };
 
-class translate : public hittable {
+/* Transform
+*
+* Instance of an object under an affine map (affine.h), stored with its inverse. A ray
+* is moved into object space once per instance and traced there, t is the same in both
+* spaces. Only a hit of the object is mapped back: p, its error bound and the normal,
+* which goes through the inverse transpose and is renormalized unless the map is rigid.
+*
+* Wrapping a transform in another composes the two matrices into one node around the
+* inner object, so chains like translate(rotate_y(box)) cost a single ray transform.
+* Bounds are the box around the eight mapped corners of the object's box, widened by
+* the rounding of that mapping so they stay conservative.
+*/
+class transform : public hittable {
 	public:
-		translate(shared_ptr<hittable> object, const vec3& offset) : object(object), offset(offset) {
-			bbox = object->bounding_box() + offset;
+		transform(shared_ptr<hittable> object, const affine& to_world) : transform(object, to_world, to_world.inverse()) {}
+
+		//With an inverse known exactly, e.g. from the affine factories
+		transform(shared_ptr<hittable> object, const affine& to_world, const affine& to_object)
+			: object(object), to_world(to_world), to_object(to_object) {
+			if (auto inner = dynamic_cast<const transform*>(object.get())) {
+				this->object = inner->object;
+				this->to_world = to_world * inner->to_world;
+				this->to_object = inner->to_object * to_object;
+			}
+
+			rigid = this->to_world.is_rigid();
+			growth = this->to_world.row_norm();
+			set_bounding_box();
 		}
 
 		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-			ray offset_r(r.origin() - offset, r.direction(), r.time());
-
-			if (!object->hit(offset_r, ray_t, rec))
+			if (!object->hit(object_ray(r), ray_t, rec))
 				return false;
 
-			rec.p += offset;
+			//Mapping scales the error by at most the row norm and rounds each sum of four terms
+			auto object_p = rec.p;
+			rec.p = to_world.point(object_p);
+			rec.p_error = growth * rec.p_error + 4 * std::numeric_limits<real>::epsilon() * (growth * max_abs(object_p) + max_abs(rec.p));
+
+			//The normal already faces the ray and the inverse transpose keeps that side
+			auto normal = to_object.transposed_vector(rec.normal);
+			rec.normal = rigid ? normal : unit_vector(normal);
 
 			return true;
 		}
 
+		bool occluded(const ray& r, interval ray_t) const override {
+			return object->occluded(object_ray(r), ray_t);
+		}
+
 		aabb bounding_box() const override { return bbox; }
 
+		const affine& matrix() const { return to_world; }
+		const shared_ptr<hittable>& instanced() const { return object; }
+
 	private:
 		shared_ptr<hittable> object;
-		vec3 offset;
+		affine to_world;
+		affine to_object;
+		bool rigid;
+		real growth; //to_world.row_norm()
 		aabb bbox;
-};
 
-class rotate_y : public hittable {
-	public:
-		rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
-			auto radians = degrees_to_radians(angle);
-			sin_theta = std::sin(radians);
-			cos_theta = std::cos(radians);
-			bbox = object->bounding_box();
+		ray object_ray(const ray& r) const {
+			return ray(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+		}
 
+		void set_bounding_box() {
+			auto box = object->bounding_box();
 			point3 min(infinity, infinity, infinity);
 			point3 max(-infinity, -infinity, -infinity);
 
-			for (int i = 0; i < 2; i++) {
-				for (int j = 0; j < 2; j++) {
-					for (int k = 0; k < 2; k++) {
-						auto x = i * bbox.x.max + (1 - i) * bbox.x.min;
-						auto y = j * bbox.y.max + (1 - j) * bbox.y.min;
-						auto z = k * bbox.z.max + (1 - k) * bbox.z.min;
-
-						auto newx = cos_theta * x + sin_theta * z;
-						auto newz = -sin_theta * x + cos_theta * z;
-
-						vec3 tester(newx, y, newz);
-
-						for (int c = 0; c < 3; c++) {
-							min[c] = std::fmin(min[c], tester[c]);
-							max[c] = std::fmax(max[c], tester[c]);
-						}
-					}
+			for (int corner = 0; corner < 8; corner++) {
+				auto p = to_world.point(point3(
+					corner & 1 ? box.x.max : box.x.min,
+					corner & 2 ? box.y.max : box.y.min,
+					corner & 4 ? box.z.max : box.z.min));
+				for (int c = 0; c < 3; c++) {
+					min[c] = std::fmin(min[c], p[c]);
+					max[c] = std::fmax(max[c], p[c]);
 				}
 			}
 
-			bbox = aabb(min, max);
-		}
-
-		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-			auto origin = point3(
-				(cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
-				r.origin().y(),
-				(sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
-			);
-
-			auto direction = vec3(
-				(cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
-				r.direction().y(),
-				(sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
-			);
-
-			ray rotated_r(origin, direction, r.time());
-
-			if (!object->hit(rotated_r, ray_t, rec))
-				return false;
-
-			rec.p = point3(
-				(cos_theta * rec.p.x()) + (sin_theta * rec.p.z()),
-				rec.p.y(),
-				(-sin_theta * rec.p.x()) + (cos_theta * rec.p.z())
-			);
-
-			rec.normal = vec3(
-				(cos_theta * rec.normal.x()) + (sin_theta * rec.normal.z()),
-				rec.normal.y(),
-				(-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
-			);
-
-			return true;
+			auto rounding = 4 * std::numeric_limits<real>::epsilon() * std::fmax(max_abs(min), max_abs(max));
+			bbox = aabb(interval(min.x(), max.x()).expand(2 * rounding), interval(min.y(), max.y()).expand(2 * rounding),
+				interval(min.z(), max.z()).expand(2 * rounding));
 		}
+};
 
-	aabb bounding_box() const override { return bbox; }
+class translate : public transform {
+	public:
+		translate(shared_ptr<hittable> object, const vec3& offset)
+			: transform(object, affine::translation(offset), affine::translation(-offset)) {}
+};
 
-	private:
-		shared_ptr<hittable> object;
-		double sin_theta;
-		double cos_theta;
-		aabb bbox;
+//About the y axis by angle degrees
+class rotate_y : public transform {
+	public:
+		rotate_y(shared_ptr<hittable> object, double angle)
+			: transform(object, affine::rotation(1, angle), affine::rotation(1, -angle)) {}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,224 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "framebuffer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+enum class image_format {
+	automatic, //From the output path's extension, binary PPM for stdout
+	ppm_ascii, //P3, the original text output
+	ppm,       //P6, binary 8-bit
+	pfm,       //Portable float map, linear 32-bit HDR
+	png        //8-bit RGB PNG
+};
+
+//Writes a whole framebuffer to a stream in one format
+class image_writer {
+	public:
+		virtual ~image_writer() = default;
+
+		virtual void write(std::ostream& out, const framebuffer& image) const = 0;
+};
+
+class ppm_ascii_writer : public image_writer {
+	public:
+		void write(std::ostream& out, const framebuffer& image) const override {
+			out << "P3\n" << image.width() << ' ' << image.height() << "\n255\n";
+
+			auto bytes = image.to_bytes();
+			std::string text;
+			text.reserve(bytes.size() * 4);
+			for (size_t k = 0; k < bytes.size(); k += 3) {
+				text += std::to_string(bytes[k]) + ' ' + std::to_string(bytes[k + 1]) + ' ' + std::to_string(bytes[k + 2]) + '\n';
+			}
+			out << text;
+		}
+};
+
+class ppm_writer : public image_writer {
+	public:
+		void write(std::ostream& out, const framebuffer& image) const override {
+			out << "P6\n" << image.width() << ' ' << image.height() << "\n255\n";
+
+			auto bytes = image.to_bytes();
+			out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		}
+};
+
+//Linear floats, no gamma or clamping. A negative scale marks little-endian data, rows run bottom to top
+class pfm_writer : public image_writer {
+	public:
+		void write(std::ostream& out, const framebuffer& image) const override {
+			out << "PF\n" << image.width() << ' ' << image.height() << "\n-1.0\n";
+
+			size_t row_floats = size_t(image.width()) * 3;
+			std::vector<unsigned char> row(row_floats * 4);
+			for (int j = image.height() - 1; j >= 0; j--) {
+				const float* src = image.data() + size_t(j) * row_floats;
+				for (size_t k = 0; k < row_floats; k++)
+					put_le32(&row[k * 4], float_bits(src[k]));
+				out.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size()));
+			}
+		}
+
+	private:
+		static std::uint32_t float_bits(float f) {
+			std::uint32_t bits;
+			std::memcpy(&bits, &f, sizeof(bits));
+			return bits;
+		}
+
+		static void put_le32(unsigned char* p, std::uint32_t v) {
+			p[0] = v & 0xff;
+			p[1] = (v >> 8) & 0xff;
+			p[2] = (v >> 16) & 0xff;
+			p[3] = (v >> 24) & 0xff;
+		}
+};
+
+/* PNG Writer
+*
+* One IHDR/IDAT/IEND image with 8-bit RGB, filter 0 on every row. The zlib stream
+* uses stored (uncompressed) deflate blocks, so no compression library is needed.
+* Files are as large as P6 but open in any viewer.
+*/
+class png_writer : public image_writer {
+	public:
+		void write(std::ostream& out, const framebuffer& image) const override {
+			static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			out.write(reinterpret_cast<const char*>(signature), 8);
+
+			std::vector<unsigned char> header;
+			put_be32(header, std::uint32_t(image.width()));
+			put_be32(header, std::uint32_t(image.height()));
+			header.insert(header.end(), { 8, 2, 0, 0, 0 }); //8-bit, RGB, deflate, filter 0, no interlace
+			write_chunk(out, "IHDR", header);
+
+			auto bytes = image.to_bytes();
+			size_t row_bytes = size_t(image.width()) * 3;
+			std::vector<unsigned char> raw;
+			raw.reserve((row_bytes + 1) * image.height());
+			for (int j = 0; j < image.height(); j++) {
+				raw.push_back(0);
+				raw.insert(raw.end(), bytes.begin() + j * row_bytes, bytes.begin() + (j + 1) * row_bytes);
+			}
+
+			write_chunk(out, "IDAT", zlib_stored(raw));
+			write_chunk(out, "IEND", {});
+		}
+
+	private:
+		static void put_be32(std::vector<unsigned char>& v, std::uint32_t x) {
+			v.push_back((x >> 24) & 0xff);
+			v.push_back((x >> 16) & 0xff);
+			v.push_back((x >> 8) & 0xff);
+			v.push_back(x & 0xff);
+		}
+
+		static std::uint32_t crc32(const unsigned char* data, size_t length, std::uint32_t crc = 0xffffffffu) {
+			static const auto table = []() {
+				std::vector<std::uint32_t> t(256);
+				for (std::uint32_t n = 0; n < 256; n++) {
+					auto c = n;
+					for (int k = 0; k < 8; k++)
+						c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+					t[n] = c;
+				}
+				return t;
+			}();
+
+			for (size_t k = 0; k < length; k++)
+				crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+			return crc;
+		}
+
+		static void write_chunk(std::ostream& out, const char* type, const std::vector<unsigned char>& data) {
+			std::vector<unsigned char> chunk;
+			put_be32(chunk, std::uint32_t(data.size()));
+			chunk.insert(chunk.end(), type, type + 4);
+			chunk.insert(chunk.end(), data.begin(), data.end());
+			put_be32(chunk, crc32(chunk.data() + 4, chunk.size() - 4) ^ 0xffffffffu);
+			out.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size()));
+		}
+
+		static std::vector<unsigned char> zlib_stored(const std::vector<unsigned char>& raw) {
+			std::vector<unsigned char> z = { 0x78, 0x01 };
+
+			const size_t max_block = 65535;
+			size_t offset = 0;
+			do {
+				auto length = std::min(max_block, raw.size() - offset);
+				bool final_block = offset + length == raw.size();
+				z.push_back(final_block ? 1 : 0);
+				z.push_back(length & 0xff);
+				z.push_back((length >> 8) & 0xff);
+				z.push_back(~length & 0xff);
+				z.push_back((~length >> 8) & 0xff);
+				z.insert(z.end(), raw.begin() + offset, raw.begin() + offset + length);
+				offset += length;
+			} while (offset < raw.size());
+
+			std::uint32_t a = 1, b = 0; //Adler-32
+			for (auto byte : raw) {
+				a = (a + byte) % 65521;
+				b = (b + a) % 65521;
+			}
+			put_be32(z, (b << 16) | a);
+			return z;
+		}
+};
+
+inline image_format image_format_from_path(const std::string& path) {
+	auto dot = path.rfind('.');
+	auto extension = dot == std::string::npos ? std::string() : path.substr(dot + 1);
+
+	if (extension == "pfm") return image_format::pfm;
+	if (extension == "png") return image_format::png;
+	return image_format::ppm;
+}
+
+inline shared_ptr<image_writer> make_image_writer(image_format format) {
+	switch (format) {
+		case image_format::ppm_ascii: return make_shared<ppm_ascii_writer>();
+		case image_format::pfm: return make_shared<pfm_writer>();
+		case image_format::png: return make_shared<png_writer>();
+		default: return make_shared<ppm_writer>();
+	}
+}
+
+//Writes image to path, or to stdout (switched to binary mode on Windows) when path is empty
+inline bool write_image(const framebuffer& image, const std::string& path, image_format format = image_format::automatic) {
+	if (format == image_format::automatic)
+		format = image_format_from_path(path);
+	auto writer = make_image_writer(format);
+
+	if (path.empty()) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		writer->write(std::cout, image);
+		std::cout.flush();
+		return bool(std::cout);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "ERROR: Could not open '" << path << "' for writing.\n";
+		return false;
+	}
+	writer->write(file, image);
+	return bool(file);
+}
+
+#endif
\ No newline at end of file
@@ -5,34 +5,34 @@
 
 class interval {
 	public:
-		double min, max;
+		real min, max;
 
 		interval() : min(+infinity), max(-infinity) {}
-		interval(double min, double max) : min(min), max(max) {}
+		interval(real min, real max) : min(min), max(max) {}
 		interval(const interval& a, const interval& b) {
 			min = a.min <= b.min ? a.min : b.min;
 			max = a.max >= b.max ? a.max : b.max;
 		}
 
-		double size() const {
+		real size() const {
 			return max - min;
 		}
 
-		bool contains(double x) const {
+		bool contains(real x) const {
 			return min <= x && x <= max;
 		}
 
-		bool surrounds(double x) const {
+		bool surrounds(real x) const {
 			return min < x && x < max;
 		}
 
-		double clamp(double x) const {
+		real clamp(real x) const {
 			if (x < min) return min;
 			if (x > max) return max;
 			return x;
 		}
 
-		interval expand(double delta) const {
+		interval expand(real delta) const {
 			auto padding = delta / 2;
 			return interval(min - padding, max + padding);
 		}
@@ -43,11 +43,11 @@ class interval {
 const interval interval::empty = interval(+infinity, -infinity);
 const interval interval::universe = interval(-infinity, +infinity);
 
-interval operator+(const interval& ival, double displacement) {
+interval operator+(const interval& ival, real displacement) {
 	return interval(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+interval operator+(real displacement, const interval& ival) {
 	return ival + displacement;
 }
 
@@ -0,0 +1,246 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/* Light Sampler
+*
+* Replacement for sampling a hittable_list of lights uniformly. Each light is picked
+* with probability proportional to its power, surface area * luminance of the radiance
+* its material emits, through an alias table in O(1). Lights whose power is unknown
+* (no material, as in scenes that list lights only as sampling targets, or no area)
+* get the mean weight of the known ones, so a list without any emitters is sampled
+* uniformly exactly as before.
+*
+* pdf_value() has to sum the pdf of every light the direction could have come from,
+* which hittable_list does by calling pdf_value() (a full hit) on all of them. Here the
+* lights sit in a small BVH and only those whose box the ray enters are evaluated,
+* O(log N) for lights that don't overlap along the ray.
+*
+* The lights are not owned, the list has to outlive the sampler.
+*/
+class light_sampler : public hittable {
+	public:
+		light_sampler(const hittable& light_list) {
+			std::vector<const hittable*> unsorted;
+			if (auto list = dynamic_cast<const hittable_list*>(&light_list)) {
+				for (const auto& object : list->objects)
+					unsorted.push_back(object.get());
+			}
+			else {
+				unsorted.push_back(&light_list);
+			}
+
+			//Leaves index contiguous ranges of lights, so store them in leaf order
+			std::vector<std::uint32_t> order(unsorted.size());
+			for (std::uint32_t i = 0; i < order.size(); i++)
+				order[i] = i;
+			if (!order.empty())
+				build(unsorted, order, 0, order.size());
+			for (auto i : order)
+				lights.push_back(unsorted[i]);
+
+			build_alias_table();
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			bool hit_anything = false;
+			visit(r, ray_t, [&](const hittable& light, std::uint32_t) {
+				if (light.hit(r, ray_t, rec)) {
+					hit_anything = true;
+					ray_t.max = rec.s;
+				}
+			});
+			return hit_anything;
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			return visit(r, ray_t, [&](const hittable& light, std::uint32_t) { return light.occluded(r, ray_t); });
+		}
+
+		aabb bounding_box() const override { return nodes.empty() ? aabb::empty : nodes[0].bbox; }
+
+		double pdf_value(const point3& origin, const vec3& direction) const override {
+			auto sum = 0.0;
+			visit(ray(origin, direction), interval(0, infinity), [&](const hittable& light, std::uint32_t i) {
+				sum += pmf[i] * light.pdf_value(origin, direction);
+			});
+			return sum;
+		}
+
+		vec3 random(const point3& origin) const override {
+			if (lights.empty())
+				return vec3(1, 0, 0);
+			return lights[sample()]->random(origin);
+		}
+
+		size_t size() const { return lights.size(); }
+
+		//Probability of picking light i (in the sampler's order)
+		double probability(size_t i) const { return pmf[i]; }
+
+	private:
+		struct node {
+			aabb bbox;
+			std::uint32_t first; //Leaf: first light, interior: index of the second child (the first follows the node)
+			std::uint32_t count; //Lights in a leaf, 0 for interior nodes
+		};
+
+		static constexpr std::uint32_t max_leaf_size = 2;
+		static constexpr int max_stack = 64;
+
+		std::vector<const hittable*> lights;
+		std::vector<double> pmf;
+		std::vector<double> accept;          //Alias table: keep slot i with this probability...
+		std::vector<std::uint32_t> alias;    //...else take alias[i]
+		std::vector<node> nodes;
+
+		//One uniform number picks the slot and, from its fractional part, slot or alias
+		std::uint32_t sample() const {
+			auto u = random_double() * lights.size();
+			auto slot = std::min(std::uint32_t(u), std::uint32_t(lights.size() - 1));
+			return (u - slot) < accept[slot] ? slot : alias[slot];
+		}
+
+		//Calls f(light, index) for every light whose box r enters within ray_t. An f returning
+		//bool stops the walk once it returns true, visit() then returns true as well
+		template <typename F>
+		bool visit(const ray& r, interval ray_t, F&& f) const {
+			if (nodes.empty())
+				return false;
+
+			std::uint32_t stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+
+			while (true) {
+				const node& n = nodes[current];
+				if (n.bbox.hit(r, ray_t)) {
+					if (n.count > 0) {
+						for (auto i = n.first; i < n.first + n.count; i++) {
+							if constexpr (std::is_same_v<decltype(f(*lights[i], i)), bool>) {
+								if (f(*lights[i], i))
+									return true;
+							}
+							else {
+								f(*lights[i], i);
+							}
+						}
+					}
+					else {
+						stack[stack_size++] = n.first;
+						current = current + 1;
+						continue;
+					}
+				}
+
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+			return false;
+		}
+
+		double power(const hittable& light) const {
+			auto mat = light.surface_material();
+			auto area = light.surface_area();
+			if (!mat || !(area > 0))
+				return 0;
+
+			//Radiance leaving the front face at the light's center, textures are not integrated
+			hit_record rec;
+			rec.p = light.bounding_box().centroid();
+			rec.front_face = true;
+			rec.u = rec.v = real(0.5);
+			return area * luminance(mat->emitted(ray(), rec, rec.u, rec.v, rec.p));
+		}
+
+		//Vose's alias method over the power weights
+		void build_alias_table() {
+			auto n = lights.size();
+			std::vector<double> weights(n);
+			double known_sum = 0;
+			size_t known = 0;
+			for (size_t i = 0; i < n; i++) {
+				weights[i] = power(*lights[i]);
+				if (weights[i] > 0) {
+					known_sum += weights[i];
+					known++;
+				}
+			}
+			for (auto& w : weights)
+				if (!(w > 0))
+					w = known > 0 ? known_sum / known : 1.0;
+
+			double total = 0;
+			for (auto w : weights)
+				total += w;
+
+			pmf.resize(n);
+			accept.assign(n, 1.0);
+			alias.resize(n);
+			std::vector<double> scaled(n);
+			std::vector<std::uint32_t> small, large;
+			for (size_t i = 0; i < n; i++) {
+				pmf[i] = weights[i] / total;
+				scaled[i] = pmf[i] * n;
+				alias[i] = std::uint32_t(i);
+				(scaled[i] < 1 ? small : large).push_back(std::uint32_t(i));
+			}
+
+			while (!small.empty() && !large.empty()) {
+				auto s = small.back();
+				auto l = large.back();
+				small.pop_back();
+				large.pop_back();
+
+				accept[s] = scaled[s];
+				alias[s] = l;
+				scaled[l] = (scaled[l] + scaled[s]) - 1;
+				(scaled[l] < 1 ? small : large).push_back(l);
+			}
+			//Whatever is left is 1 up to rounding and keeps accept = 1
+		}
+
+		//Median split on the longest centroid axis, appends nodes depth-first
+		std::uint32_t build(const std::vector<const hittable*>& unsorted, std::vector<std::uint32_t>& order, size_t begin, size_t end) {
+			auto index = std::uint32_t(nodes.size());
+			nodes.push_back({ aabb::empty, 0, 0 });
+
+			aabb bounds = aabb::empty;
+			aabb centroids = aabb::empty;
+			for (auto i = begin; i < end; i++) {
+				auto box = unsorted[order[i]]->bounding_box();
+				bounds = aabb(bounds, box);
+				auto c = box.centroid();
+				centroids = aabb(centroids, aabb(c, c));
+			}
+			nodes[index].bbox = bounds;
+
+			if (end - begin <= max_leaf_size) {
+				nodes[index].first = std::uint32_t(begin);
+				nodes[index].count = std::uint32_t(end - begin);
+				return index;
+			}
+
+			int axis = centroids.longest_axis();
+			auto mid = begin + (end - begin) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+				return unsorted[a]->bounding_box().centroid()[axis] < unsorted[b]->bounding_box().centroid()[axis];
+			});
+
+			build(unsorted, order, begin, mid);
+			nodes[index].first = build(unsorted, order, mid, end);
+			return index;
+		}
+};
+
+#endif
\ No newline at end of file
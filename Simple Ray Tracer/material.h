@@ -8,7 +8,7 @@
 class scatter_record {
 public:
 	color attenuation;
-	shared_ptr<pdf> pdf_ptr;
+	pdf scatter_pdf; //Held by value, see pdf.h
 	bool skip_pdf;
 	ray skip_pdf_ray;
 };
@@ -41,7 +41,7 @@ class lambertian : public material {
 
 		bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
 			srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-			srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+			srec.scatter_pdf = cosine_pdf(rec.normal);
 			srec.skip_pdf = false;
 			return true;
 		}
@@ -66,7 +66,6 @@ class metal : public material {
 			reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
 
 			srec.attenuation = albedo;
-			srec.pdf_ptr = nullptr;
 			srec.skip_pdf = true;
 			srec.skip_pdf_ray = ray(rec.p, reflected, r_in.time());
 
@@ -85,7 +84,6 @@ class dielectric : public material {
 
 		bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
 			srec.attenuation = color(1.0, 1.0, 1.0);
-			srec.pdf_ptr = nullptr;
 			srec.skip_pdf = true;
 			double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
 
@@ -140,7 +138,7 @@ public:
 
 	bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
 		srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-		srec.pdf_ptr = make_shared<sphere_pdf>();
+		srec.scatter_pdf = sphere_pdf();
 		srec.skip_pdf = false;
 		return true;
 	}
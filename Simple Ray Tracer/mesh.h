@@ -0,0 +1,360 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "flat_bvh_node.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/* Mesh Data
+*
+* Indexed triangle buffers as loaded from a file (mesh_loader.h) or generated. Every
+* triangle is three entries of indices into positions. Normals and uvs are optional:
+* with their own index lists (OBJ, where each corner picks its attributes separately)
+* or, when those are empty, indexed like the positions (PLY, per-vertex attributes).
+*/
+struct mesh_data {
+	std::vector<point3> positions;
+	std::vector<vec3> normals;
+	std::vector<real> uvs;                     //(u, v) pairs
+	std::vector<std::uint32_t> indices;        //Three positions per triangle
+	std::vector<std::uint32_t> normal_indices; //Empty -> indices
+	std::vector<std::uint32_t> uv_indices;     //Empty -> indices
+
+	size_t triangle_count() const { return indices.size() / 3; }
+
+	size_t memory_bytes() const {
+		return positions.capacity() * sizeof(point3) + normals.capacity() * sizeof(vec3) + uvs.capacity() * sizeof(real)
+			+ (indices.capacity() + normal_indices.capacity() + uv_indices.capacity()) * sizeof(std::uint32_t);
+	}
+};
+
+/* Triangle Mesh
+*
+* One hittable for a whole mesh instead of one per triangle. The buffers are shared
+* (several meshes, or tlas instances of one, can use the same mesh_data) and the
+* triangles sit in the mesh's own BVH: binned SAH, stored flat in depth-first order
+* in flat_bvh_nodes like flat_bvh, leaves holding up to max_leaf_size triangle
+* indices. Rays are tested with Moller-Trumbore. Shading normals and uvs are
+* interpolated from the vertices when the mesh has them, otherwise the face normal and
+* the barycentric coordinates are used.
+*/
+class triangle_mesh : public hittable {
+	public:
+		triangle_mesh(shared_ptr<const mesh_data> data, const material* mat) : data(std::move(data)), mat(mat) {
+			build();
+		}
+
+		triangle_mesh(mesh_data data, const material* mat) : triangle_mesh(make_shared<const mesh_data>(std::move(data)), mat) {}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			std::uint32_t closest = 0;
+			real t = 0, b1 = 0, b2 = 0;
+			if (!traverse<false>(r, ray_t, closest, t, b1, b2))
+				return false;
+
+			const std::uint32_t* corner = &data->indices[3 * size_t(closest)];
+			const point3& p0 = data->positions[corner[0]];
+			const point3& p1 = data->positions[corner[1]];
+			const point3& p2 = data->positions[corner[2]];
+			real b0 = 1 - b1 - b2;
+
+			//Interpolated from the vertices rather than r.at(t), off the plane by rounding only
+			rec.s = t;
+			rec.p = b0 * p0 + b1 * p1 + b2 * p2;
+			rec.p_error = 8 * std::numeric_limits<real>::epsilon() * std::fmax(max_abs(p0), std::fmax(max_abs(p1), max_abs(p2)));
+			rec.set_face_normal(r, unit_vector(cross(p1 - p0, p2 - p0)));
+			rec.mat = mat;
+
+			if (!data->normals.empty()) {
+				const std::uint32_t* n = data->normal_indices.empty() ? corner : &data->normal_indices[3 * size_t(closest)];
+				vec3 shading = b0 * data->normals[n[0]] + b1 * data->normals[n[1]] + b2 * data->normals[n[2]];
+				auto length = shading.length();
+				if (length > 0) {
+					//Kept on the face's side, and spawn_origin() offsets along it, so stretch the bound to still clear the face
+					shading = shading / length;
+					auto cosine = dot(shading, rec.normal);
+					if (cosine < 0) {
+						shading = -shading;
+						cosine = -cosine;
+					}
+					rec.normal = shading;
+					rec.p_error /= std::fmax(cosine, real(0.1));
+				}
+			}
+
+			if (!data->uvs.empty()) {
+				const std::uint32_t* uv = data->uv_indices.empty() ? corner : &data->uv_indices[3 * size_t(closest)];
+				rec.u = b0 * data->uvs[2 * uv[0]] + b1 * data->uvs[2 * uv[1]] + b2 * data->uvs[2 * uv[2]];
+				rec.v = b0 * data->uvs[2 * uv[0] + 1] + b1 * data->uvs[2 * uv[1] + 1] + b2 * data->uvs[2 * uv[2] + 1];
+			}
+			else {
+				rec.u = b1;
+				rec.v = b2;
+			}
+
+			return true;
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			std::uint32_t triangle;
+			real t, b1, b2;
+			return traverse<true>(r, ray_t, triangle, t, b1, b2);
+		}
+
+		aabb bounding_box() const override { return bbox; }
+
+		double surface_area() const override { return area; }
+		const material* surface_material() const override { return mat; }
+
+		const mesh_data& buffers() const { return *data; }
+		size_t triangle_count() const { return data->triangle_count(); }
+		size_t node_count() const { return nodes.size(); }
+
+		//The BVH, the shared buffers are counted by mesh_data::memory_bytes()
+		size_t memory_bytes() const {
+			return nodes.capacity() * sizeof(flat_bvh_node) + order.capacity() * sizeof(std::uint32_t);
+		}
+
+	private:
+		//Float box of a triangle or a group of them, rounded outwards from the vertices
+		struct bounds {
+			float min[3] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+			float max[3] = { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+			bounds() = default;
+			bounds(const bounds& a, const bounds& b) : bounds(a) { grow(b); }
+
+			void grow(const bounds& b) {
+				for (int axis = 0; axis < 3; axis++) {
+					min[axis] = b.min[axis] < min[axis] ? b.min[axis] : min[axis];
+					max[axis] = b.max[axis] > max[axis] ? b.max[axis] : max[axis];
+				}
+			}
+
+			float centroid(int axis) const { return 0.5f * (min[axis] + max[axis]); }
+
+			float surface_area() const {
+				if (!(max[0] >= min[0]))
+					return 0;
+				float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+				return 2 * (dx * dy + dy * dz + dz * dx);
+			}
+		};
+
+		static constexpr std::uint32_t max_leaf_size = 4;
+		static constexpr int bin_count = 16;
+		static constexpr int max_stack = 64;
+
+		shared_ptr<const mesh_data> data;
+		const material* mat;
+		std::vector<flat_bvh_node> nodes; //Leaf offset/count index order
+		std::vector<std::uint32_t> order; //Triangles in leaf order
+		aabb bbox;
+		double area = 0;
+
+		//Single ray walk, nearest child first. any_hit returns at the first triangle inside ray_t
+		template <bool any_hit>
+		bool traverse(const ray& r, interval ray_t, std::uint32_t& closest, real& t, real& b1, real& b2) const {
+			if (nodes.empty())
+				return false;
+
+			const point3& orig = r.origin();
+			const vec3& dir = r.direction();
+			const double inv_dir[3] = { 1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2] };
+			const bool dir_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+			std::uint32_t stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+			bool hit_anything = false;
+
+			while (true) {
+				const flat_bvh_node& n = nodes[current];
+
+				if (slab_hit(n, orig, inv_dir, ray_t)) {
+					if (n.count > 0) {
+						for (std::uint32_t i = n.offset; i < n.offset + n.count; i++) {
+							real candidate_t, candidate_b1, candidate_b2;
+							if (intersect(order[i], r, ray_t, candidate_t, candidate_b1, candidate_b2)) {
+								if constexpr (any_hit)
+									return true;
+								hit_anything = true;
+								closest = order[i];
+								t = ray_t.max = candidate_t;
+								b1 = candidate_b1;
+								b2 = candidate_b2;
+							}
+						}
+					}
+					else {
+						if (dir_negative[n.axis]) {
+							stack[stack_size++] = current + 1;
+							current = n.offset;
+						}
+						else {
+							stack[stack_size++] = n.offset;
+							current = current + 1;
+						}
+						continue;
+					}
+				}
+
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+
+			return hit_anything;
+		}
+
+		//Moller-Trumbore: distance t and barycentrics (b1, b2) of vertices 1 and 2
+		bool intersect(std::uint32_t triangle, const ray& r, const interval& ray_t, real& t, real& b1, real& b2) const {
+			const std::uint32_t* corner = &data->indices[3 * size_t(triangle)];
+			const point3& p0 = data->positions[corner[0]];
+			vec3 e1 = data->positions[corner[1]] - p0;
+			vec3 e2 = data->positions[corner[2]] - p0;
+
+			vec3 pvec = cross(r.direction(), e2);
+			real det = dot(e1, pvec);
+			if (det == 0) //Parallel, or a degenerate triangle
+				return false;
+			real inv_det = 1 / det;
+
+			vec3 tvec = r.origin() - p0;
+			b1 = dot(tvec, pvec) * inv_det;
+			if (b1 < 0 || b1 > 1)
+				return false;
+
+			vec3 qvec = cross(tvec, e1);
+			b2 = dot(r.direction(), qvec) * inv_det;
+			if (b2 < 0 || b1 + b2 > 1)
+				return false;
+
+			t = dot(e2, qvec) * inv_det;
+			return ray_t.contains(t);
+		}
+
+		void build() {
+			auto count = data->triangle_count();
+			std::vector<bounds> boxes(count);
+			bounds all;
+			for (size_t i = 0; i < count; i++) {
+				const std::uint32_t* corner = &data->indices[3 * i];
+				for (int k = 0; k < 3; k++) {
+					const point3& p = data->positions[corner[k]];
+					for (int axis = 0; axis < 3; axis++) {
+						boxes[i].min[axis] = std::fmin(boxes[i].min[axis], round_down(p[axis]));
+						boxes[i].max[axis] = std::fmax(boxes[i].max[axis], round_up(p[axis]));
+					}
+				}
+				all.grow(boxes[i]);
+
+				const point3& p0 = data->positions[corner[0]];
+				area += 0.5 * cross(data->positions[corner[1]] - p0, data->positions[corner[2]] - p0).length();
+			}
+
+			if (count == 0) {
+				bbox = aabb::empty;
+				return;
+			}
+			bbox = aabb(interval(all.min[0], all.max[0]), interval(all.min[1], all.max[1]), interval(all.min[2], all.max[2])); //Pads flat meshes
+
+			order.resize(count);
+			for (std::uint32_t i = 0; i < order.size(); i++)
+				order[i] = i;
+			nodes.reserve(2 * count / max_leaf_size + 1);
+			build_node(boxes, 0, count, 1);
+		}
+
+		std::uint32_t build_node(const std::vector<bounds>& boxes, size_t begin, size_t end, int depth) {
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+
+			bounds box, centroids;
+			for (auto i = begin; i < end; i++) {
+				const bounds& b = boxes[order[i]];
+				box.grow(b);
+				for (int axis = 0; axis < 3; axis++) {
+					auto c = b.centroid(axis);
+					centroids.min[axis] = c < centroids.min[axis] ? c : centroids.min[axis];
+					centroids.max[axis] = c > centroids.max[axis] ? c : centroids.max[axis];
+				}
+			}
+			for (int axis = 0; axis < 3; axis++) {
+				nodes[index].min[axis] = box.min[axis];
+				nodes[index].max[axis] = box.max[axis];
+			}
+
+			if (end - begin <= max_leaf_size) {
+				nodes[index].offset = std::uint32_t(begin);
+				nodes[index].count = std::uint16_t(end - begin);
+				return index;
+			}
+
+			int axis = 0;
+			for (int a = 1; a < 3; a++)
+				if (centroids.max[a] - centroids.min[a] > centroids.max[axis] - centroids.min[axis])
+					axis = a;
+
+			//Deep trees fall back to median splits, which bound the depth and keep the stack small
+			auto mid = depth < max_stack / 2 ? partition_sah(boxes, begin, end, centroids, axis) : begin;
+			if (mid == begin || mid == end) {
+				mid = begin + (end - begin) / 2;
+				std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+					return boxes[a].centroid(axis) < boxes[b].centroid(axis);
+				});
+			}
+			nodes[index].axis = std::uint8_t(axis);
+
+			build_node(boxes, begin, mid, depth + 1);
+			auto second = build_node(boxes, mid, end, depth + 1);
+			nodes[index].offset = second;
+			return index;
+		}
+
+		//Binned SAH over the triangle centroids. Returns the split point and its axis
+		size_t partition_sah(const std::vector<bounds>& boxes, size_t begin, size_t end, const bounds& centroids, int& split_axis) {
+			int best_axis = -1, best_split = 0;
+			auto best_cost = infinity;
+
+			for (int axis = 0; axis < 3; axis++) {
+				float extent_min = centroids.min[axis];
+				float extent = centroids.max[axis] - extent_min;
+				if (!(extent > 0))
+					continue;
+				float scale = bin_count / extent;
+
+				bounds bin_bounds[bin_count];
+				size_t bin_counts[bin_count] = {};
+				for (auto i = begin; i < end; i++) {
+					const bounds& b = boxes[order[i]];
+					int bin = clamp_bin<bin_count>((b.centroid(axis) - extent_min) * scale);
+					bin_counts[bin]++;
+					bin_bounds[bin].grow(b);
+				}
+
+				sah_sweep(bin_bounds, bin_counts, axis, best_cost, best_axis, best_split);
+			}
+
+			if (best_axis < 0)
+				return begin;
+
+			split_axis = best_axis;
+			float extent_min = centroids.min[best_axis];
+			float scale = bin_count / (centroids.max[best_axis] - extent_min);
+			auto middle = std::partition(order.begin() + begin, order.begin() + end, [&](std::uint32_t i) {
+				return clamp_bin<bin_count>((boxes[i].centroid(best_axis) - extent_min) * scale) < best_split;
+			});
+			return size_t(middle - order.begin());
+		}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,776 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "mesh.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Read-only view of a whole file, paged in by the OS as the parsers touch it
+class mapped_file {
+	public:
+		mapped_file(const std::string& path) {
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size))
+				return;
+			length = size_t(file_size.QuadPart);
+			opened = true;
+			if (length == 0)
+				return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+				view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			opened = view != nullptr;
+#else
+			descriptor = open(path.c_str(), O_RDONLY);
+			if (descriptor < 0)
+				return;
+			struct stat info;
+			if (fstat(descriptor, &info) != 0)
+				return;
+			length = size_t(info.st_size);
+			opened = true;
+			if (length == 0)
+				return;
+			void* memory = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (memory == MAP_FAILED) {
+				opened = false;
+				return;
+			}
+			view = static_cast<const char*>(memory);
+			madvise(memory, length, MADV_SEQUENTIAL);
+#endif
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		~mapped_file() {
+#ifdef _WIN32
+			if (view)
+				UnmapViewOfFile(view);
+			if (mapping)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+#else
+			if (view)
+				munmap(const_cast<char*>(view), length);
+			if (descriptor >= 0)
+				close(descriptor);
+#endif
+		}
+
+		bool is_open() const { return opened; }
+		const char* data() const { return view; }
+		size_t size() const { return length; }
+
+	private:
+		const char* view = nullptr;
+		size_t length = 0;
+		bool opened = false;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int descriptor = -1;
+#endif
+};
+
+/* OBJ Loader
+*
+* The file is split into one run of whole lines per thread. Each thread parses its run
+* into local buffers, with faces fanned into triangles, then the runs are copied into
+* the mesh in parallel at offsets known from the counts. Indices are 1-based, negative
+* ones count back from the last vertex read, which across runs is only known once the
+* earlier runs are counted, so those are stored run-relative and fixed up while copying.
+* Only geometry is read (v, vt, vn, f). Normals and uvs are kept only if every face uses
+* them. Files it cannot read return false with the reason in error.
+*/
+class obj_loader {
+	public:
+		static bool load(const char* text, size_t size, mesh_data& mesh, int thread_count, std::string& error) {
+			int parts = int(std::min<size_t>(size_t(resolve_thread_count(thread_count)), size / min_part_bytes + 1));
+
+			//Part boundaries moved forward to just past a newline
+			std::vector<size_t> starts(parts + 1, size);
+			starts[0] = 0;
+			for (int part = 1; part < parts; part++) {
+				auto start = std::max(size * part / parts, starts[part - 1]);
+				while (start < size && text[start - 1] != '\n')
+					start++;
+				starts[part] = start;
+			}
+
+			std::vector<run> runs(parts);
+			run_parts(parts, [&](int part) { runs[part].parse(text + starts[part], text + starts[part + 1]); });
+
+			size_t positions = 0, normals = 0, uvs = 0, triangles = 0;
+			bool has_normals = true, has_uvs = true;
+			for (auto& r : runs) {
+				if (r.failed) {
+					error = "could not parse line " + std::string(r.failed_line, std::find(r.failed_line, text + size, '\n'));
+					return false;
+				}
+				r.position_offset = positions;
+				r.normal_offset = normals;
+				r.uv_offset = uvs;
+				r.triangle_offset = triangles;
+				positions += r.positions.size();
+				normals += r.normals.size();
+				uvs += r.uvs.size() / 2;
+				triangles += r.corners.size() / 9;
+				has_normals = has_normals && !r.missing_normal;
+				has_uvs = has_uvs && !r.missing_uv;
+			}
+			has_normals = has_normals && normals > 0;
+			has_uvs = has_uvs && uvs > 0;
+
+			mesh = mesh_data();
+			mesh.positions.resize(positions);
+			mesh.indices.resize(3 * triangles);
+			if (has_normals) {
+				mesh.normals.resize(normals);
+				mesh.normal_indices.resize(3 * triangles);
+			}
+			if (has_uvs) {
+				mesh.uvs.resize(2 * uvs);
+				mesh.uv_indices.resize(3 * triangles);
+			}
+
+			std::vector<char> out_of_range(parts, 0);
+			run_parts(parts, [&](int part) {
+				auto& r = runs[part];
+				std::copy(r.positions.begin(), r.positions.end(), mesh.positions.begin() + r.position_offset);
+				if (has_normals)
+					std::copy(r.normals.begin(), r.normals.end(), mesh.normals.begin() + r.normal_offset);
+				if (has_uvs)
+					std::copy(r.uvs.begin(), r.uvs.end(), mesh.uvs.begin() + 2 * r.uv_offset);
+
+				for (auto i : r.relative)
+					r.corners[i] += std::int64_t(i % 3 == 0 ? r.position_offset : i % 3 == 1 ? r.uv_offset : r.normal_offset);
+
+				const size_t limits[3] = { positions, uvs, normals };
+				for (size_t c = 0; c < r.corners.size(); c += 3) {
+					auto out = 3 * r.triangle_offset + c / 3;
+					for (int k = 0; k < 3; k++) {
+						auto value = r.corners[c + k];
+						if ((k == 1 && !has_uvs) || (k == 2 && !has_normals))
+							continue;
+						if (value < 0 || std::uint64_t(value) >= limits[k]) {
+							out_of_range[part] = 1;
+							continue;
+						}
+						auto index = std::uint32_t(value);
+						(k == 0 ? mesh.indices : k == 1 ? mesh.uv_indices : mesh.normal_indices)[out] = index;
+					}
+				}
+			});
+
+			if (std::find(out_of_range.begin(), out_of_range.end(), 1) != out_of_range.end()) {
+				error = "a face refers to a vertex that does not exist";
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		static constexpr size_t min_part_bytes = 1 << 20; //Smaller files aren't worth a thread per part
+		static constexpr std::int64_t missing = -(std::int64_t(1) << 62);
+
+		//One part's lines: attributes in file order, triangles as (position, uv, normal) per corner
+		struct run {
+			std::vector<point3> positions;
+			std::vector<vec3> normals;
+			std::vector<real> uvs;
+			std::vector<std::int64_t> corners; //0-based indices, relative ones before their fix-up
+			std::vector<size_t> relative;      //Entries of corners given as negative (relative) indices
+			bool missing_normal = false;
+			bool missing_uv = false;
+			const char* failed_line = nullptr;
+			bool failed = false;
+
+			size_t position_offset = 0, normal_offset = 0, uv_offset = 0, triangle_offset = 0;
+
+			void parse(const char* p, const char* end) {
+				std::vector<std::int64_t> face;
+				std::vector<char> face_relative;
+				while (p < end && !failed) {
+					auto line = p;
+					auto line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+					if (!line_end)
+						line_end = end;
+					p = line_end + 1;
+
+					auto c = skip_space(line, line_end);
+					if (c == line_end || *c == '#')
+						continue;
+
+					bool ok = true;
+					if (c[0] == 'v' && c + 1 < line_end && is_space(c[1])) {
+						double x, y, z;
+						ok = number(c + 1, line_end, x, c) && number(c, line_end, y, c) && number(c, line_end, z, c);
+						positions.emplace_back(real(x), real(y), real(z));
+					}
+					else if (c[0] == 'v' && c + 2 < line_end && c[1] == 'n' && is_space(c[2])) {
+						double x, y, z;
+						ok = number(c + 2, line_end, x, c) && number(c, line_end, y, c) && number(c, line_end, z, c);
+						normals.emplace_back(real(x), real(y), real(z));
+					}
+					else if (c[0] == 'v' && c + 2 < line_end && c[1] == 't' && is_space(c[2])) {
+						double u, v = 0;
+						ok = number(c + 2, line_end, u, c);
+						if (ok && skip_space(c, line_end) != line_end && !number(c, line_end, v, c))
+							ok = false;
+						uvs.push_back(real(u));
+						uvs.push_back(real(v));
+					}
+					else if (c[0] == 'f' && c + 1 < line_end && is_space(c[1])) {
+						ok = parse_face(c + 1, line_end, face, face_relative);
+					}
+
+					if (!ok) {
+						failed = true;
+						failed_line = line;
+					}
+				}
+			}
+
+			//Corners v, v/vt, v//vn or v/vt/vn, fanned around the first corner
+			bool parse_face(const char* c, const char* end, std::vector<std::int64_t>& face, std::vector<char>& face_relative) {
+				face.clear();
+				face_relative.clear();
+				const size_t counts[3] = { positions.size(), uvs.size() / 2, normals.size() };
+				while (true) {
+					c = skip_space(c, end);
+					if (c == end || *c == '#')
+						break;
+
+					std::int64_t corner[3] = { missing, missing, missing };
+					if (!index(c, end, corner[0], c))
+						return false;
+					if (c < end && *c == '/') {
+						c++;
+						if (c < end && *c != '/' && !index(c, end, corner[1], c))
+							return false;
+						if (c < end && *c == '/') {
+							c++;
+							if (!index(c, end, corner[2], c))
+								return false;
+						}
+					}
+					if (c < end && !is_space(*c))
+						return false;
+
+					for (int k = 0; k < 3; k++) {
+						auto value = corner[k];
+						if (value == missing)
+							(k == 1 ? missing_uv : missing_normal) = true;
+						face.push_back(value < 0 && value != missing ? value + std::int64_t(counts[k]) : value - 1);
+						face_relative.push_back(value < 0 && value != missing);
+					}
+				}
+				if (face.size() < 9)
+					return false;
+
+				for (size_t v = 3; v + 3 < face.size(); v += 3) {
+					for (size_t corner : { size_t(0), v, v + 3 }) {
+						for (size_t k = 0; k < 3; k++) {
+							if (face_relative[corner + k])
+								relative.push_back(corners.size());
+							corners.push_back(face[corner + k]);
+						}
+					}
+				}
+				return true;
+			}
+		};
+
+		static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+		static const char* skip_space(const char* c, const char* end) {
+			while (c < end && is_space(*c))
+				c++;
+			return c;
+		}
+
+		static bool number(const char* c, const char* end, double& value, const char*& next) {
+			c = skip_space(c, end);
+			if (c < end && *c == '+')
+				c++;
+			auto result = std::from_chars(c, end, value);
+			next = result.ptr;
+			return result.ec == std::errc();
+		}
+
+		static bool index(const char* c, const char* end, std::int64_t& value, const char*& next) {
+			auto result = std::from_chars(c, end, value);
+			next = result.ptr;
+			return result.ec == std::errc() && value != 0;
+		}
+};
+
+/* Binary PLY Loader
+*
+* Reads binary_little_endian and binary_big_endian files: x, y, z and, when present,
+* nx, ny, nz and u, v (or s, t) of the vertex element, and the vertex_indices list of
+* the face element, fanned into triangles. Properties may have any PLY scalar type,
+* other properties and elements are skipped. Vertices have a fixed size, so threads
+* convert disjoint ranges of them. Faces do too when every face is a triangle (meshes
+* almost always are), which the threads check as they go, otherwise they are read
+* serially. Files it cannot read return false with the reason in error.
+*/
+class ply_loader {
+	public:
+		static bool load(const char* data, size_t size, mesh_data& mesh, int thread_count, std::string& error) {
+			header h;
+			if (!parse_header(data, size, h, error))
+				return false;
+
+			const char* p = data + h.data_offset;
+			const char* end = data + size;
+			mesh = mesh_data();
+			int threads = resolve_thread_count(thread_count);
+
+			for (const auto& e : h.elements) {
+				if (e.name == "vertex") {
+					if (!read_vertices(e, h.swap, p, end, mesh, threads, error))
+						return false;
+				}
+				else if (e.name == "face") {
+					if (!read_faces(e, h.swap, p, end, mesh, threads, error))
+						return false;
+				}
+				else if (!skip_element(e, h.swap, p, end)) {
+					error = "element '" + e.name + "' is truncated";
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		enum class scalar { int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+		struct property {
+			std::string name;
+			scalar type;
+			bool is_list = false;
+			scalar count_type = scalar::uint8; //Lists only
+		};
+
+		struct element {
+			std::string name;
+			size_t count = 0;
+			std::vector<property> properties;
+
+			//Bytes per entry when no property is a list, otherwise 0
+			size_t fixed_size() const {
+				size_t total = 0;
+				for (const auto& prop : properties) {
+					if (prop.is_list)
+						return 0;
+					total += scalar_size(prop.type);
+				}
+				return total;
+			}
+
+			int find(std::initializer_list<const char*> names) const {
+				for (auto name : names)
+					for (size_t i = 0; i < properties.size(); i++)
+						if (properties[i].name == name)
+							return int(i);
+				return -1;
+			}
+		};
+
+		struct header {
+			std::vector<element> elements;
+			size_t data_offset = 0;
+			bool swap = false; //File byte order differs from the host's
+		};
+
+		static constexpr size_t min_part_count = 1 << 16; //Fewer entries aren't worth a thread per part
+
+		static size_t scalar_size(scalar type) {
+			switch (type) {
+				case scalar::int8: case scalar::uint8: return 1;
+				case scalar::int16: case scalar::uint16: return 2;
+				case scalar::int32: case scalar::uint32: case scalar::float32: return 4;
+				default: return 8;
+			}
+		}
+
+		static bool parse_scalar(const std::string& name, scalar& type) {
+			static const std::pair<const char*, scalar> names[] = {
+				{ "char", scalar::int8 }, { "int8", scalar::int8 }, { "uchar", scalar::uint8 }, { "uint8", scalar::uint8 },
+				{ "short", scalar::int16 }, { "int16", scalar::int16 }, { "ushort", scalar::uint16 }, { "uint16", scalar::uint16 },
+				{ "int", scalar::int32 }, { "int32", scalar::int32 }, { "uint", scalar::uint32 }, { "uint32", scalar::uint32 },
+				{ "float", scalar::float32 }, { "float32", scalar::float32 }, { "double", scalar::float64 }, { "float64", scalar::float64 }
+			};
+			for (const auto& n : names) {
+				if (name == n.first) {
+					type = n.second;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//Value at p in the file's byte order, as a double (exact for every PLY type but large 64-bit ones, which PLY lacks)
+		static double read_scalar(const char* p, scalar type, bool swap) {
+			unsigned char bytes[8];
+			auto n = scalar_size(type);
+			std::memcpy(bytes, p, n);
+			if (swap)
+				std::reverse(bytes, bytes + n);
+
+			switch (type) {
+				case scalar::int8: { std::int8_t v; std::memcpy(&v, bytes, 1); return v; }
+				case scalar::uint8: return bytes[0];
+				case scalar::int16: { std::int16_t v; std::memcpy(&v, bytes, 2); return v; }
+				case scalar::uint16: { std::uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+				case scalar::int32: { std::int32_t v; std::memcpy(&v, bytes, 4); return v; }
+				case scalar::uint32: { std::uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+				case scalar::float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+				default: { double v; std::memcpy(&v, bytes, 8); return v; }
+			}
+		}
+
+		static bool parse_header(const char* data, size_t size, header& h, std::string& error) {
+			const char* p = data;
+			const char* end = data + size;
+			auto next_line = [&](std::string& line) {
+				auto line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+				if (!line_end)
+					return false;
+				line.assign(p, line_end);
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				p = line_end + 1;
+				return true;
+			};
+			auto words = [](const std::string& line) {
+				std::vector<std::string> out;
+				size_t i = 0;
+				while (i < line.size()) {
+					while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i])))
+						i++;
+					size_t start = i;
+					while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i])))
+						i++;
+					if (i > start)
+						out.push_back(line.substr(start, i - start));
+				}
+				return out;
+			};
+
+			std::string line;
+			if (!next_line(line) || line != "ply") {
+				error = "not a PLY file";
+				return false;
+			}
+
+			const std::uint16_t probe = 1;
+			bool host_little = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+			bool has_format = false;
+			while (true) {
+				if (!next_line(line)) {
+					error = "the header has no end_header";
+					return false;
+				}
+				auto w = words(line);
+				if (w.empty() || w[0] == "comment" || w[0] == "obj_info")
+					continue;
+				if (w[0] == "end_header")
+					break;
+
+				if (w[0] == "format" && w.size() >= 2) {
+					if (w[1] == "ascii") {
+						error = "ASCII PLY is not supported, only binary";
+						return false;
+					}
+					if (w[1] != "binary_little_endian" && w[1] != "binary_big_endian") {
+						error = "unknown format '" + w[1] + "'";
+						return false;
+					}
+					h.swap = (w[1] == "binary_little_endian") != host_little;
+					has_format = true;
+				}
+				else if (w[0] == "element" && w.size() == 3) {
+					element e;
+					e.name = w[1];
+					e.count = size_t(std::strtoull(w[2].c_str(), nullptr, 10));
+					h.elements.push_back(e);
+				}
+				else if (w[0] == "property" && !h.elements.empty()) {
+					property prop;
+					bool ok;
+					if (w.size() == 5 && w[1] == "list") {
+						prop.is_list = true;
+						prop.name = w[4];
+						ok = parse_scalar(w[2], prop.count_type) && parse_scalar(w[3], prop.type);
+					}
+					else {
+						prop.name = w.size() == 3 ? w[2] : "";
+						ok = w.size() == 3 && parse_scalar(w[1], prop.type);
+					}
+					if (!ok) {
+						error = "unknown property '" + line + "'";
+						return false;
+					}
+					h.elements.back().properties.push_back(prop);
+				}
+				else {
+					error = "unexpected header line '" + line + "'";
+					return false;
+				}
+			}
+
+			if (!has_format) {
+				error = "the header has no format";
+				return false;
+			}
+			h.data_offset = size_t(p - data);
+			return true;
+		}
+
+		static bool skip_property(const property& prop, bool swap, const char*& p, const char* end) {
+			size_t bytes = scalar_size(prop.type);
+			if (prop.is_list) {
+				if (size_t(end - p) < scalar_size(prop.count_type))
+					return false;
+				bytes *= size_t(read_scalar(p, prop.count_type, swap));
+				p += scalar_size(prop.count_type);
+			}
+			if (size_t(end - p) < bytes)
+				return false;
+			p += bytes;
+			return true;
+		}
+
+		static bool skip_element(const element& e, bool swap, const char*& p, const char* end) {
+			auto fixed = e.fixed_size();
+			if (fixed > 0) {
+				if (size_t(end - p) / fixed < e.count)
+					return false;
+				p += fixed * e.count;
+				return true;
+			}
+			for (size_t i = 0; i < e.count; i++)
+				for (const auto& prop : e.properties)
+					if (!skip_property(prop, swap, p, end))
+						return false;
+			return true;
+		}
+
+		static bool read_vertices(const element& e, bool swap, const char*& p, const char* end, mesh_data& mesh, int threads, std::string& error) {
+			auto stride = e.fixed_size();
+			int x = e.find({ "x" }), y = e.find({ "y" }), z = e.find({ "z" });
+			if (stride == 0 || x < 0 || y < 0 || z < 0) {
+				error = "the vertex element needs x, y and z and no list properties";
+				return false;
+			}
+			if (size_t(end - p) / stride < e.count) {
+				error = "the vertex data is truncated";
+				return false;
+			}
+			if (e.count > std::numeric_limits<std::uint32_t>::max()) {
+				error = "too many vertices";
+				return false;
+			}
+
+			int nx = e.find({ "nx" }), ny = e.find({ "ny" }), nz = e.find({ "nz" });
+			int u = e.find({ "u", "s", "texture_u", "texture_s" }), v = e.find({ "v", "t", "texture_v", "texture_t" });
+			bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+			bool has_uvs = u >= 0 && v >= 0;
+
+			std::vector<size_t> offsets;
+			size_t offset = 0;
+			for (const auto& prop : e.properties) {
+				offsets.push_back(offset);
+				offset += scalar_size(prop.type);
+			}
+
+			mesh.positions.resize(e.count);
+			if (has_normals)
+				mesh.normals.resize(e.count);
+			if (has_uvs)
+				mesh.uvs.resize(2 * e.count);
+
+			const char* base = p;
+			auto get = [&](const char* entry, int index) { return read_scalar(entry + offsets[index], e.properties[index].type, swap); };
+			int parts = int(std::min<size_t>(size_t(threads), e.count / min_part_count + 1));
+			run_parts(parts, [&](int part) {
+				for (size_t i = e.count * part / parts; i < e.count * (part + 1) / parts; i++) {
+					const char* entry = base + i * stride;
+					mesh.positions[i] = point3(real(get(entry, x)), real(get(entry, y)), real(get(entry, z)));
+					if (has_normals)
+						mesh.normals[i] = vec3(real(get(entry, nx)), real(get(entry, ny)), real(get(entry, nz)));
+					if (has_uvs) {
+						mesh.uvs[2 * i] = real(get(entry, u));
+						mesh.uvs[2 * i + 1] = real(get(entry, v));
+					}
+				}
+			});
+
+			p += stride * e.count;
+			return true;
+		}
+
+		static bool read_faces(const element& e, bool swap, const char*& p, const char* end, mesh_data& mesh, int threads, std::string& error) {
+			int list = e.find({ "vertex_indices", "vertex_index" });
+			if (list < 0 || !e.properties[list].is_list) {
+				error = "the face element has no vertex_indices list";
+				return false;
+			}
+			const property& indices = e.properties[list];
+			auto count_size = scalar_size(indices.count_type);
+			auto index_size = scalar_size(indices.type);
+			auto vertex_count = mesh.positions.size();
+
+			//Triangles only: every face is the same size, so each thread can take its own range
+			if (e.properties.size() == 1) {
+				auto stride = count_size + 3 * index_size;
+				if (size_t(end - p) / stride >= e.count) {
+					mesh.indices.resize(3 * e.count);
+					std::vector<char> valid(std::max(threads, 1), 1), in_range(std::max(threads, 1), 1);
+					const char* base = p;
+					int parts = int(std::min<size_t>(size_t(threads), e.count / min_part_count + 1));
+					run_parts(parts, [&](int part) {
+						for (size_t i = e.count * part / parts; i < e.count * (part + 1) / parts; i++) {
+							const char* entry = base + i * stride;
+							if (read_scalar(entry, indices.count_type, swap) != 3) {
+								valid[part] = 0;
+								return;
+							}
+							for (int k = 0; k < 3; k++) {
+								auto index = read_scalar(entry + count_size + k * index_size, indices.type, swap);
+								if (!(index >= 0 && index < double(vertex_count))) {
+									in_range[part] = 0; //Before the conversion, which is undefined out of range
+									return;
+								}
+								mesh.indices[3 * i + k] = std::uint32_t(index);
+							}
+						}
+					});
+
+					if (std::find(valid.begin(), valid.end(), 0) == valid.end()) {
+						if (std::find(in_range.begin(), in_range.end(), 0) != in_range.end()) {
+							error = "a face refers to a vertex that does not exist";
+							return false;
+						}
+						p += stride * e.count;
+						return true;
+					}
+					mesh.indices.clear();
+				}
+			}
+
+			//Polygons or extra face properties: one face after another, fanned around its first vertex
+			mesh.indices.reserve(3 * e.count);
+			std::vector<std::uint32_t> polygon;
+			for (size_t i = 0; i < e.count; i++) {
+				for (size_t k = 0; k < e.properties.size(); k++) {
+					const property& prop = e.properties[k];
+					if (k != size_t(list)) {
+						if (!skip_property(prop, swap, p, end)) {
+							error = "the face data is truncated";
+							return false;
+						}
+						continue;
+					}
+
+					if (size_t(end - p) < count_size) {
+						error = "the face data is truncated";
+						return false;
+					}
+					auto n = size_t(read_scalar(p, prop.count_type, swap));
+					p += count_size;
+					if (size_t(end - p) / index_size < n) {
+						error = "the face data is truncated";
+						return false;
+					}
+
+					polygon.clear();
+					for (size_t j = 0; j < n; j++, p += index_size) {
+						auto index = read_scalar(p, prop.type, swap);
+						if (!(index >= 0 && index < double(vertex_count))) {
+							error = "a face refers to a vertex that does not exist";
+							return false;
+						}
+						polygon.push_back(std::uint32_t(index));
+					}
+					for (size_t j = 1; j + 1 < polygon.size(); j++)
+						mesh.indices.insert(mesh.indices.end(), { polygon[0], polygon[j], polygon[j + 1] });
+				}
+			}
+			return true;
+		}
+};
+
+//Loads an .obj or binary .ply file (by extension) into mesh, parsing on thread_count threads (0 -> all cores).
+//Logs the size and load rate, or the reason it failed
+inline bool load_mesh(const std::string& path, mesh_data& mesh, int thread_count = 0) {
+	auto dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	for (auto& c : extension)
+		c = char(std::tolower(static_cast<unsigned char>(c)));
+	if (extension != "obj" && extension != "ply") {
+		std::cerr << "ERROR: '" << path << "' is not an .obj or .ply file.\n";
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	mapped_file file(path);
+	if (!file.is_open()) {
+		std::cerr << "ERROR: Could not open mesh file '" << path << "'.\n";
+		return false;
+	}
+
+	std::string error;
+	bool loaded = extension == "obj" ? obj_loader::load(file.data(), file.size(), mesh, thread_count, error)
+		: ply_loader::load(file.data(), file.size(), mesh, thread_count, error);
+	if (!loaded) {
+		std::cerr << "ERROR: Could not load '" << path << "': " << error << ".\n";
+		mesh = mesh_data();
+		return false;
+	}
+
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::clog << "Loaded '" << path << "': " << mesh.triangle_count() << " triangles, " << mesh.positions.size() << " vertices in "
+		<< seconds << " s (" << mesh.triangle_count() / seconds / 1e6 << " M triangles/s, " << file.size() / seconds / 1e6 << " MB/s)\n";
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -4,38 +4,39 @@
 #include "onb.h"
 #include "hittable_list.h"
 
-class pdf {
-public:
-    virtual ~pdf() {}
+#include <variant>
 
-    virtual double value(const vec3& direction) const = 0;
-
-    virtual vec3 generate() const = 0;
-};
+/* PDFs
+*
+* The set of sampling distributions is closed, so a pdf is a std::variant of the
+* concrete kinds rather than a heap-allocated subclass. Scatter records, light
+* sampling and mixtures all hold them by value on the stack, which keeps every
+* path vertex free of allocations and reference counts.
+*/
 
-class sphere_pdf : public pdf {
+class sphere_pdf {
 public:
     sphere_pdf() {}
 
-    double value(const vec3& direction) const override {
+    double value(const vec3& direction) const {
         return 1 / (4 * pi);
     }
 
-    vec3 generate() const override {
+    vec3 generate() const {
         return random_unit_vector();
     }
 };
 
-class cosine_pdf : public pdf {
+class cosine_pdf {
 public:
     cosine_pdf(const vec3& w) : uvw(w) {}
 
-    double value(const vec3& direction) const override {
+    double value(const vec3& direction) const {
         auto cosine_theta = dot(unit_vector(direction), uvw.w());
         return std::fmax(0, cosine_theta / pi);
     }
 
-    vec3 generate() const override {
+    vec3 generate() const {
         return uvw.transform(random_cosine_direction());
     }
 
@@ -43,46 +44,66 @@ private:
     onb uvw;
 };
 
-class hittable_pdf : public pdf {
+class hittable_pdf {
 public:
     hittable_pdf(const hittable& objects, const point3& origin)
-        : objects(objects), origin(origin)
+        : objects(&objects), origin(origin)
     {
     }
 
-    double value(const vec3& direction) const override {
-        return objects.pdf_value(origin, direction);
+    double value(const vec3& direction) const {
+        return objects->pdf_value(origin, direction);
     }
 
-    vec3 generate() const override {
-        return objects.random(origin);
+    vec3 generate() const {
+        return objects->random(origin);
     }
 
 private:
-    const hittable& objects;
+    const hittable* objects; //Pointer rather than reference so the pdf stays assignable
     point3 origin;
 };
 
-class mixture_pdf : public pdf {
+class pdf {
+public:
+    pdf() {}
+
+    pdf(const sphere_pdf& p) : kind(p) {}
+    pdf(const cosine_pdf& p) : kind(p) {}
+    pdf(const hittable_pdf& p) : kind(p) {}
+
+    double value(const vec3& direction) const {
+        return std::visit([&](const auto& p) { return p.value(direction); }, kind);
+    }
+
+    vec3 generate() const {
+        return std::visit([](const auto& p) { return p.generate(); }, kind);
+    }
+
+private:
+    std::variant<sphere_pdf, cosine_pdf, hittable_pdf> kind;
+};
+
+class mixture_pdf {
 public:
-    mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
+    mixture_pdf(const pdf& p0, const pdf& p1) {
         p[0] = p0;
         p[1] = p1;
     }
 
-    double value(const vec3& direction) const override {
-        return 0.5 * p[0]->value(direction) + 0.5 * p[1]->value(direction);
+    double value(const vec3& direction) const {
+        return 0.5 * p[0].value(direction) + 0.5 * p[1].value(direction);
     }
 
-    vec3 generate() const override {
+    vec3 generate() const {
         if (random_double() < 0.5)
-            return p[0]->generate();
+            return p[0].generate();
         else
-            return p[1]->generate();
+            return p[1].generate();
     }
 
 private:
-    shared_ptr<pdf> p[2];
+    pdf p[2];
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,434 @@
+#ifndef PRIMITIVE_SOA_H
+#define PRIMITIVE_SOA_H
+
+#include "hittable.h"
+#include "quad.h"
+#include "simd.h"
+#include "sphere.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//The SIMD distance kernels work on double lanes, a float build runs the scalar one
+#if defined(SRT_X86) && !defined(SRT_FLOAT_PRECISION)
+#define SRT_SOA_KERNELS 1
+#endif
+
+//Primitive kinds a soa_bvh leaf run can hold, custom runs call hittable::hit
+enum class primitive_type : std::uint8_t { sphere, quad, custom };
+
+//Longest run of one type that a hit_run() call takes
+constexpr std::uint32_t max_primitive_run = 16;
+
+/* Sphere SoA
+*
+* One array per component, spheres of a leaf run are consecutive. A distance kernel
+* computes the entry distance of every sphere in the run, 4 at a time with AVX2,
+* 2 with SSE2 or one by one, and nearest() reduces them to the closest index. Only
+* that sphere's surface interaction is computed. Every kernel follows sphere::hit
+* operation for operation (the AVX2 one is built without FMA), so all of them give
+* bit-identical hits unless the compiler itself contracts the scalar code (-march=native).
+*/
+class sphere_soa {
+	public:
+		std::vector<real> center_x, center_y, center_z; //At time 0
+		std::vector<real> motion_x, motion_y, motion_z; //Center displacement over the shutter, 0 when stationary
+		std::vector<real> radius;
+		std::vector<const material*> mat;
+
+		sphere_soa(simd_isa isa = simd_isa::avx2) { select_kernel(isa); }
+
+		size_t size() const { return radius.size(); }
+
+		void add(const sphere& s) {
+			center_x.push_back(s.center.origin().x());
+			center_y.push_back(s.center.origin().y());
+			center_z.push_back(s.center.origin().z());
+			motion_x.push_back(s.center.direction().x());
+			motion_y.push_back(s.center.direction().y());
+			motion_z.push_back(s.center.direction().z());
+			radius.push_back(s.radius);
+			mat.push_back(s.mat);
+		}
+
+		void select_kernel(simd_isa isa) {
+			isa_used = supported_simd_isa(isa);
+#ifdef SRT_SOA_KERNELS
+			if (isa_used == simd_isa::avx2) {
+				kernel = &distances_avx2;
+				return;
+			}
+			if (isa_used == simd_isa::sse) {
+				kernel = &distances_sse;
+				return;
+			}
+#endif
+			isa_used = simd_isa::scalar;
+			kernel = &distances_scalar;
+		}
+
+		simd_isa kernel_isa() const { return isa_used; }
+
+		//Nearest sphere of [first, first + count) hit inside ray_t and its distance, count <= max_primitive_run
+		std::uint32_t nearest(const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real& t) const {
+			real distance[max_primitive_run];
+			kernel(*this, r, first, count, ray_t, distance);
+
+			std::uint32_t best = count;
+			for (std::uint32_t k = 0; k < count; k++) {
+				if (distance[k] < ray_t.max) {
+					ray_t.max = distance[k];
+					best = k;
+				}
+			}
+			t = ray_t.max;
+			return best;
+		}
+
+		bool hit_run(const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, hit_record& rec) const {
+			real t;
+			auto best = nearest(r, first, count, ray_t, t);
+			if (best == count)
+				return false;
+
+			auto i = first + best;
+			auto time = r.time();
+			point3 current_center = point3(center_x[i], center_y[i], center_z[i]) + time * vec3(motion_x[i], motion_y[i], motion_z[i]);
+			rec.s = t;
+			rec.p = r.at(rec.s);
+			vec3 from_center = rec.p - current_center;
+			rec.p = current_center + from_center * (radius[i] / from_center.length());
+			rec.p_error = 8 * std::numeric_limits<real>::epsilon() * (max_abs(current_center) + radius[i]);
+			vec3 outward_normal = (rec.p - current_center) / radius[i];
+			rec.set_face_normal(r, outward_normal);
+			sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+			rec.mat = mat[i];
+			return true;
+		}
+
+	private:
+		using kernel_fn = void (*)(const sphere_soa&, const ray&, std::uint32_t, std::uint32_t, interval, real*);
+
+		kernel_fn kernel;
+		simd_isa isa_used;
+
+		//Entry distance of sphere i inside ray_t, infinity for a miss
+		real distance(const ray& r, std::uint32_t i, interval ray_t) const {
+			const real ox = r.origin().x(), oy = r.origin().y(), oz = r.origin().z();
+			const real dx = r.direction().x(), dy = r.direction().y(), dz = r.direction().z();
+			const real time = r.time();
+			const real a = dx * dx + dy * dy + dz * dz;
+
+			auto ocx = (center_x[i] + time * motion_x[i]) - ox;
+			auto ocy = (center_y[i] + time * motion_y[i]) - oy;
+			auto ocz = (center_z[i] + time * motion_z[i]) - oz;
+			auto h = dx * ocx + dy * ocy + dz * ocz;
+			auto c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius[i] * radius[i];
+
+			auto discriminant = h * h - a * c;
+			if (!(discriminant >= 0))
+				return infinity;
+
+			auto sqrtd = std::sqrt(discriminant);
+			auto root = (h - sqrtd) / a;
+			if (ray_t.surrounds(root))
+				return root;
+			root = (h + sqrtd) / a;
+			return ray_t.surrounds(root) ? root : infinity;
+		}
+
+		static void distances_scalar(const sphere_soa& s, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			for (std::uint32_t k = 0; k < count; k++)
+				t[k] = s.distance(r, first + k, ray_t);
+		}
+
+#ifdef SRT_SOA_KERNELS
+		SRT_TARGET_SSE
+		static void distances_sse(const sphere_soa& s, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			const __m128d ox = _mm_set1_pd(r.origin().x()), oy = _mm_set1_pd(r.origin().y()), oz = _mm_set1_pd(r.origin().z());
+			const __m128d dx = _mm_set1_pd(r.direction().x()), dy = _mm_set1_pd(r.direction().y()), dz = _mm_set1_pd(r.direction().z());
+			const __m128d time = _mm_set1_pd(r.time());
+			const __m128d a = _mm_set1_pd(r.direction().x() * r.direction().x() + r.direction().y() * r.direction().y()
+				+ r.direction().z() * r.direction().z());
+			const __m128d t_min = _mm_set1_pd(ray_t.min), t_max = _mm_set1_pd(ray_t.max);
+			const __m128d zero = _mm_setzero_pd(), miss = _mm_set1_pd(infinity);
+
+			std::uint32_t k = 0;
+			for (; k + 2 <= count; k += 2) {
+				auto i = first + k;
+				__m128d ocx = _mm_sub_pd(_mm_add_pd(_mm_loadu_pd(&s.center_x[i]), _mm_mul_pd(time, _mm_loadu_pd(&s.motion_x[i]))), ox);
+				__m128d ocy = _mm_sub_pd(_mm_add_pd(_mm_loadu_pd(&s.center_y[i]), _mm_mul_pd(time, _mm_loadu_pd(&s.motion_y[i]))), oy);
+				__m128d ocz = _mm_sub_pd(_mm_add_pd(_mm_loadu_pd(&s.center_z[i]), _mm_mul_pd(time, _mm_loadu_pd(&s.motion_z[i]))), oz);
+				__m128d rad = _mm_loadu_pd(&s.radius[i]);
+
+				__m128d h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)), _mm_mul_pd(dz, ocz));
+				__m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz)), _mm_mul_pd(rad, rad));
+				__m128d discriminant = _mm_sub_pd(_mm_mul_pd(h, h), _mm_mul_pd(a, c));
+				__m128d sqrtd = _mm_sqrt_pd(_mm_max_pd(discriminant, zero));
+
+				__m128d near_root = _mm_div_pd(_mm_sub_pd(h, sqrtd), a);
+				__m128d far_root = _mm_div_pd(_mm_add_pd(h, sqrtd), a);
+				__m128d near_in = _mm_and_pd(_mm_cmplt_pd(t_min, near_root), _mm_cmplt_pd(near_root, t_max));
+				__m128d far_in = _mm_and_pd(_mm_cmplt_pd(t_min, far_root), _mm_cmplt_pd(far_root, t_max));
+
+				//SSE2 has no blend: select with and/andnot/or
+				__m128d root = _mm_or_pd(_mm_and_pd(far_in, far_root), _mm_andnot_pd(far_in, miss));
+				root = _mm_or_pd(_mm_and_pd(near_in, near_root), _mm_andnot_pd(near_in, root));
+				__m128d valid = _mm_cmpge_pd(discriminant, zero);
+				_mm_storeu_pd(&t[k], _mm_or_pd(_mm_and_pd(valid, root), _mm_andnot_pd(valid, miss)));
+			}
+			for (; k < count; k++)
+				t[k] = s.distance(r, first + k, ray_t);
+		}
+
+		SRT_TARGET_AVX2_NO_FMA
+		static void distances_avx2(const sphere_soa& s, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			const __m256d ox = _mm256_set1_pd(r.origin().x()), oy = _mm256_set1_pd(r.origin().y()), oz = _mm256_set1_pd(r.origin().z());
+			const __m256d dx = _mm256_set1_pd(r.direction().x()), dy = _mm256_set1_pd(r.direction().y()), dz = _mm256_set1_pd(r.direction().z());
+			const __m256d time = _mm256_set1_pd(r.time());
+			const __m256d a = _mm256_set1_pd(r.direction().x() * r.direction().x() + r.direction().y() * r.direction().y()
+				+ r.direction().z() * r.direction().z());
+			const __m256d t_min = _mm256_set1_pd(ray_t.min), t_max = _mm256_set1_pd(ray_t.max);
+			const __m256d zero = _mm256_setzero_pd(), miss = _mm256_set1_pd(infinity);
+
+			std::uint32_t k = 0;
+			for (; k + 4 <= count; k += 4) {
+				auto i = first + k;
+				__m256d ocx = _mm256_sub_pd(_mm256_add_pd(_mm256_loadu_pd(&s.center_x[i]), _mm256_mul_pd(time, _mm256_loadu_pd(&s.motion_x[i]))), ox);
+				__m256d ocy = _mm256_sub_pd(_mm256_add_pd(_mm256_loadu_pd(&s.center_y[i]), _mm256_mul_pd(time, _mm256_loadu_pd(&s.motion_y[i]))), oy);
+				__m256d ocz = _mm256_sub_pd(_mm256_add_pd(_mm256_loadu_pd(&s.center_z[i]), _mm256_mul_pd(time, _mm256_loadu_pd(&s.motion_z[i]))), oz);
+				__m256d rad = _mm256_loadu_pd(&s.radius[i]);
+
+				__m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)), _mm256_mul_pd(dz, ocz));
+				__m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)),
+					_mm256_mul_pd(rad, rad));
+				__m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(a, c));
+				__m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+
+				__m256d near_root = _mm256_div_pd(_mm256_sub_pd(h, sqrtd), a);
+				__m256d far_root = _mm256_div_pd(_mm256_add_pd(h, sqrtd), a);
+				__m256d near_in = _mm256_and_pd(_mm256_cmp_pd(t_min, near_root, _CMP_LT_OQ), _mm256_cmp_pd(near_root, t_max, _CMP_LT_OQ));
+				__m256d far_in = _mm256_and_pd(_mm256_cmp_pd(t_min, far_root, _CMP_LT_OQ), _mm256_cmp_pd(far_root, t_max, _CMP_LT_OQ));
+
+				__m256d root = _mm256_blendv_pd(_mm256_blendv_pd(miss, far_root, far_in), near_root, near_in);
+				__m256d valid = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+				_mm256_storeu_pd(&t[k], _mm256_blendv_pd(miss, root, valid));
+			}
+			for (; k < count; k++)
+				t[k] = s.distance(r, first + k, ray_t);
+		}
+#endif
+};
+
+/* Quad SoA
+*
+* Corner Q, edges u and v, the plane (normal, D) and w = n / (n . n) per quad. The
+* distance kernels intersect the planes and run the interior test for the whole run,
+* the (alpha, beta) surface coordinates are recomputed only for the nearest quad.
+* As for spheres, all kernels round exactly like quad::hit.
+*/
+class quad_soa {
+	public:
+		std::vector<real> q_x, q_y, q_z;
+		std::vector<real> u_x, u_y, u_z;
+		std::vector<real> v_x, v_y, v_z;
+		std::vector<real> w_x, w_y, w_z;
+		std::vector<real> normal_x, normal_y, normal_z;
+		std::vector<real> d;
+		std::vector<const material*> mat;
+
+		quad_soa(simd_isa isa = simd_isa::avx2) { select_kernel(isa); }
+
+		size_t size() const { return d.size(); }
+
+		void add(const quad& q) {
+			q_x.push_back(q.Q.x()); q_y.push_back(q.Q.y()); q_z.push_back(q.Q.z());
+			u_x.push_back(q.u.x()); u_y.push_back(q.u.y()); u_z.push_back(q.u.z());
+			v_x.push_back(q.v.x()); v_y.push_back(q.v.y()); v_z.push_back(q.v.z());
+			w_x.push_back(q.w.x()); w_y.push_back(q.w.y()); w_z.push_back(q.w.z());
+			normal_x.push_back(q.normal.x()); normal_y.push_back(q.normal.y()); normal_z.push_back(q.normal.z());
+			d.push_back(q.D);
+			mat.push_back(q.mat);
+		}
+
+		void select_kernel(simd_isa isa) {
+			isa_used = supported_simd_isa(isa);
+#ifdef SRT_SOA_KERNELS
+			if (isa_used == simd_isa::avx2) {
+				kernel = &distances_avx2;
+				return;
+			}
+			if (isa_used == simd_isa::sse) {
+				kernel = &distances_sse;
+				return;
+			}
+#endif
+			isa_used = simd_isa::scalar;
+			kernel = &distances_scalar;
+		}
+
+		simd_isa kernel_isa() const { return isa_used; }
+
+		//Nearest quad of [first, first + count) hit inside ray_t and its distance, count <= max_primitive_run
+		std::uint32_t nearest(const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real& t) const {
+			real distance[max_primitive_run];
+			kernel(*this, r, first, count, ray_t, distance);
+
+			//<= like a list of quads, where a later quad at the same distance wins
+			std::uint32_t best = count;
+			for (std::uint32_t k = 0; k < count; k++) {
+				if (distance[k] <= ray_t.max && distance[k] != infinity) {
+					ray_t.max = distance[k];
+					best = k;
+				}
+			}
+			t = ray_t.max;
+			return best;
+		}
+
+		bool hit_run(const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, hit_record& rec) const {
+			real t;
+			auto best = nearest(r, first, count, ray_t, t);
+			if (best == count)
+				return false;
+
+			auto i = first + best;
+			real alpha, beta;
+			distance(r, i, interval::universe, alpha, beta);
+			rec.s = t;
+			rec.p = r.at(rec.s);
+			rec.p_error = hit_point_error(r, rec.p);
+			rec.u = alpha;
+			rec.v = beta;
+			rec.mat = mat[i];
+			rec.set_face_normal(r, vec3(normal_x[i], normal_y[i], normal_z[i]));
+			return true;
+		}
+
+	private:
+		using kernel_fn = void (*)(const quad_soa&, const ray&, std::uint32_t, std::uint32_t, interval, real*);
+
+		kernel_fn kernel;
+		simd_isa isa_used;
+
+		//Distance to quad i inside ray_t (infinity for a miss) and the hit's coordinates along u and v
+		real distance(const ray& r, std::uint32_t i, interval ray_t, real& alpha, real& beta) const {
+			const real ox = r.origin().x(), oy = r.origin().y(), oz = r.origin().z();
+			const real dx = r.direction().x(), dy = r.direction().y(), dz = r.direction().z();
+
+			auto denom = normal_x[i] * dx + normal_y[i] * dy + normal_z[i] * dz;
+			auto hit_t = (d[i] - (normal_x[i] * ox + normal_y[i] * oy + normal_z[i] * oz)) / denom;
+
+			//Planar hit point relative to Q
+			auto px = (ox + hit_t * dx) - q_x[i];
+			auto py = (oy + hit_t * dy) - q_y[i];
+			auto pz = (oz + hit_t * dz) - q_z[i];
+			alpha = w_x[i] * (py * v_z[i] - pz * v_y[i]) + w_y[i] * (pz * v_x[i] - px * v_z[i]) + w_z[i] * (px * v_y[i] - py * v_x[i]);
+			beta = w_x[i] * (u_y[i] * pz - u_z[i] * py) + w_y[i] * (u_z[i] * px - u_x[i] * pz) + w_z[i] * (u_x[i] * py - u_y[i] * px);
+
+			bool valid = std::fabs(denom) >= 1e-8 && ray_t.contains(hit_t)
+				&& 0 <= alpha && alpha <= 1 && 0 <= beta && beta <= 1;
+			return valid ? hit_t : infinity;
+		}
+
+		static void distances_scalar(const quad_soa& q, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			real alpha, beta;
+			for (std::uint32_t k = 0; k < count; k++)
+				t[k] = q.distance(r, first + k, ray_t, alpha, beta);
+		}
+
+#ifdef SRT_SOA_KERNELS
+		SRT_TARGET_SSE
+		static void distances_sse(const quad_soa& q, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			const __m128d ox = _mm_set1_pd(r.origin().x()), oy = _mm_set1_pd(r.origin().y()), oz = _mm_set1_pd(r.origin().z());
+			const __m128d dx = _mm_set1_pd(r.direction().x()), dy = _mm_set1_pd(r.direction().y()), dz = _mm_set1_pd(r.direction().z());
+			const __m128d t_min = _mm_set1_pd(ray_t.min), t_max = _mm_set1_pd(ray_t.max);
+			const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0), epsilon = _mm_set1_pd(1e-8);
+			const __m128d sign = _mm_set1_pd(-0.0), miss = _mm_set1_pd(infinity);
+
+			std::uint32_t k = 0;
+			for (; k + 2 <= count; k += 2) {
+				auto i = first + k;
+				__m128d nx = _mm_loadu_pd(&q.normal_x[i]), ny = _mm_loadu_pd(&q.normal_y[i]), nz = _mm_loadu_pd(&q.normal_z[i]);
+				__m128d denom = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nx, dx), _mm_mul_pd(ny, dy)), _mm_mul_pd(nz, dz));
+				__m128d plane = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nx, ox), _mm_mul_pd(ny, oy)), _mm_mul_pd(nz, oz));
+				__m128d hit_t = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(&q.d[i]), plane), denom);
+
+				__m128d px = _mm_sub_pd(_mm_add_pd(ox, _mm_mul_pd(hit_t, dx)), _mm_loadu_pd(&q.q_x[i]));
+				__m128d py = _mm_sub_pd(_mm_add_pd(oy, _mm_mul_pd(hit_t, dy)), _mm_loadu_pd(&q.q_y[i]));
+				__m128d pz = _mm_sub_pd(_mm_add_pd(oz, _mm_mul_pd(hit_t, dz)), _mm_loadu_pd(&q.q_z[i]));
+
+				__m128d ux = _mm_loadu_pd(&q.u_x[i]), uy = _mm_loadu_pd(&q.u_y[i]), uz = _mm_loadu_pd(&q.u_z[i]);
+				__m128d vx = _mm_loadu_pd(&q.v_x[i]), vy = _mm_loadu_pd(&q.v_y[i]), vz = _mm_loadu_pd(&q.v_z[i]);
+				__m128d wx = _mm_loadu_pd(&q.w_x[i]), wy = _mm_loadu_pd(&q.w_y[i]), wz = _mm_loadu_pd(&q.w_z[i]);
+
+				__m128d alpha = _mm_add_pd(_mm_add_pd(
+					_mm_mul_pd(wx, _mm_sub_pd(_mm_mul_pd(py, vz), _mm_mul_pd(pz, vy))),
+					_mm_mul_pd(wy, _mm_sub_pd(_mm_mul_pd(pz, vx), _mm_mul_pd(px, vz)))),
+					_mm_mul_pd(wz, _mm_sub_pd(_mm_mul_pd(px, vy), _mm_mul_pd(py, vx))));
+				__m128d beta = _mm_add_pd(_mm_add_pd(
+					_mm_mul_pd(wx, _mm_sub_pd(_mm_mul_pd(uy, pz), _mm_mul_pd(uz, py))),
+					_mm_mul_pd(wy, _mm_sub_pd(_mm_mul_pd(uz, px), _mm_mul_pd(ux, pz)))),
+					_mm_mul_pd(wz, _mm_sub_pd(_mm_mul_pd(ux, py), _mm_mul_pd(uy, px))));
+
+				__m128d valid = _mm_cmpge_pd(_mm_andnot_pd(sign, denom), epsilon);
+				valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmple_pd(t_min, hit_t), _mm_cmple_pd(hit_t, t_max)));
+				valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmple_pd(zero, alpha), _mm_cmple_pd(alpha, one)));
+				valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmple_pd(zero, beta), _mm_cmple_pd(beta, one)));
+				_mm_storeu_pd(&t[k], _mm_or_pd(_mm_and_pd(valid, hit_t), _mm_andnot_pd(valid, miss)));
+			}
+
+			real alpha, beta;
+			for (; k < count; k++)
+				t[k] = q.distance(r, first + k, ray_t, alpha, beta);
+		}
+
+		SRT_TARGET_AVX2_NO_FMA
+		static void distances_avx2(const quad_soa& q, const ray& r, std::uint32_t first, std::uint32_t count, interval ray_t, real* t) {
+			const __m256d ox = _mm256_set1_pd(r.origin().x()), oy = _mm256_set1_pd(r.origin().y()), oz = _mm256_set1_pd(r.origin().z());
+			const __m256d dx = _mm256_set1_pd(r.direction().x()), dy = _mm256_set1_pd(r.direction().y()), dz = _mm256_set1_pd(r.direction().z());
+			const __m256d t_min = _mm256_set1_pd(ray_t.min), t_max = _mm256_set1_pd(ray_t.max);
+			const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), epsilon = _mm256_set1_pd(1e-8);
+			const __m256d sign = _mm256_set1_pd(-0.0), miss = _mm256_set1_pd(infinity);
+
+			std::uint32_t k = 0;
+			for (; k + 4 <= count; k += 4) {
+				auto i = first + k;
+				__m256d nx = _mm256_loadu_pd(&q.normal_x[i]), ny = _mm256_loadu_pd(&q.normal_y[i]), nz = _mm256_loadu_pd(&q.normal_z[i]);
+				__m256d denom = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(nx, dx), _mm256_mul_pd(ny, dy)), _mm256_mul_pd(nz, dz));
+				__m256d plane = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(nx, ox), _mm256_mul_pd(ny, oy)), _mm256_mul_pd(nz, oz));
+				__m256d hit_t = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(&q.d[i]), plane), denom);
+
+				__m256d px = _mm256_sub_pd(_mm256_add_pd(ox, _mm256_mul_pd(hit_t, dx)), _mm256_loadu_pd(&q.q_x[i]));
+				__m256d py = _mm256_sub_pd(_mm256_add_pd(oy, _mm256_mul_pd(hit_t, dy)), _mm256_loadu_pd(&q.q_y[i]));
+				__m256d pz = _mm256_sub_pd(_mm256_add_pd(oz, _mm256_mul_pd(hit_t, dz)), _mm256_loadu_pd(&q.q_z[i]));
+
+				__m256d ux = _mm256_loadu_pd(&q.u_x[i]), uy = _mm256_loadu_pd(&q.u_y[i]), uz = _mm256_loadu_pd(&q.u_z[i]);
+				__m256d vx = _mm256_loadu_pd(&q.v_x[i]), vy = _mm256_loadu_pd(&q.v_y[i]), vz = _mm256_loadu_pd(&q.v_z[i]);
+				__m256d wx = _mm256_loadu_pd(&q.w_x[i]), wy = _mm256_loadu_pd(&q.w_y[i]), wz = _mm256_loadu_pd(&q.w_z[i]);
+
+				__m256d alpha = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(wx, _mm256_sub_pd(_mm256_mul_pd(py, vz), _mm256_mul_pd(pz, vy))),
+					_mm256_mul_pd(wy, _mm256_sub_pd(_mm256_mul_pd(pz, vx), _mm256_mul_pd(px, vz)))),
+					_mm256_mul_pd(wz, _mm256_sub_pd(_mm256_mul_pd(px, vy), _mm256_mul_pd(py, vx))));
+				__m256d beta = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(wx, _mm256_sub_pd(_mm256_mul_pd(uy, pz), _mm256_mul_pd(uz, py))),
+					_mm256_mul_pd(wy, _mm256_sub_pd(_mm256_mul_pd(uz, px), _mm256_mul_pd(ux, pz)))),
+					_mm256_mul_pd(wz, _mm256_sub_pd(_mm256_mul_pd(ux, py), _mm256_mul_pd(uy, px))));
+
+				__m256d valid = _mm256_cmp_pd(_mm256_andnot_pd(sign, denom), epsilon, _CMP_GE_OQ);
+				valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(t_min, hit_t, _CMP_LE_OQ), _mm256_cmp_pd(hit_t, t_max, _CMP_LE_OQ)));
+				valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(zero, alpha, _CMP_LE_OQ), _mm256_cmp_pd(alpha, one, _CMP_LE_OQ)));
+				valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(zero, beta, _CMP_LE_OQ), _mm256_cmp_pd(beta, one, _CMP_LE_OQ)));
+				_mm256_storeu_pd(&t[k], _mm256_blendv_pd(miss, hit_t, valid));
+			}
+
+			real alpha, beta;
+			for (; k < count; k++)
+				t[k] = q.distance(r, first + k, ray_t, alpha, beta);
+		}
+#endif
+};
+
+#endif
\ No newline at end of file
@@ -6,7 +6,7 @@
 
 class quad : public hittable {
 	public:
-		quad(const point3& Q, const vec3& u, const vec3& v, shared_ptr<material> mat) : Q(Q), u(u), v(v), mat(mat) {
+		quad(const point3& Q, const vec3& u, const vec3& v, const material* mat) : Q(Q), u(u), v(v), mat(mat) {
 			auto n = cross(u, v);
 			normal = unit_vector(n);
 			D = dot(normal, Q);
@@ -19,42 +19,37 @@ class quad : public hittable {
 
 		virtual void set_bounding_box() {
 			auto bbox_diagonal1 = aabb(Q, Q + u + v);
-			auto bbox_diagonal2 = aabb(Q + u, Q + u + v);
+			auto bbox_diagonal2 = aabb(Q + u, Q + v);
+			auto box = aabb(bbox_diagonal1, bbox_diagonal2);
+			bbox = aabb(box.x, box.y, box.z); //Pads the flat axis so slab tests can hit it
 		}
 
 		aabb bounding_box() const override { return bbox; }
 
 		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-			auto denom = dot(normal, r.direction());
-
-			//Parallel
-			if (std::fabs(denom) < 1e-8)
-				return false;
-
-			//Outside interval
-			auto t = (D - dot(normal, r.origin())) / denom;
-			if (!ray_t.contains(t))
-				return false;
-
-			//Check within planar shape
-			auto intersect = r.at(t);
-			vec3 planar_hitpt_vector = intersect - Q;
-			auto alpha = dot(w, cross(planar_hitpt_vector, v));
-			auto beta = dot(w, cross(u, planar_hitpt_vector));
-
-			if (!is_interior(alpha, beta, rec))
+			real t, alpha, beta;
+			if (!plane_hit(r, ray_t, t, alpha, beta) || !is_interior(alpha, beta, rec))
 				return false;
 
 			//Hits
+			auto intersect = r.at(t);
 			rec.s = t;
 			rec.p = intersect;
+			rec.p_error = hit_point_error(r, intersect);
 			rec.mat = mat;
 			rec.set_face_normal(r, normal);
 			
 			return true;
 		}
 
-		virtual bool is_interior(double a, double b, hit_record& rec) const {
+		//is_interior() only writes (u, v) into the scratch record, nothing else is filled in
+		bool occluded(const ray& r, interval ray_t) const override {
+			real t, alpha, beta;
+			hit_record scratch;
+			return plane_hit(r, ray_t, t, alpha, beta) && is_interior(alpha, beta, scratch);
+		}
+
+		virtual bool is_interior(real a, real b, hit_record& rec) const {
 			interval unit_interval(0, 1);
 
 			if (!unit_interval.contains(a) || !unit_interval.contains(b))
@@ -67,7 +62,7 @@ class quad : public hittable {
 
 		double pdf_value(const point3& origin, const vec3& direction) const override {
 			hit_record rec;
-			if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+			if (!this->hit(ray(origin, direction), interval(0, infinity), rec))
 				return 0;
 
 			auto distance_squared = rec.s * rec.s * direction.length_squared();
@@ -81,20 +76,48 @@ class quad : public hittable {
 			return p - origin;
 		}
 
+		double surface_area() const override { return area; }
+		const material* surface_material() const override { return mat; }
+
 	private:
+		friend class quad_soa; //Copies the geometry into SoA arrays
+
 		point3 Q;
 		vec3 u, v;
 		vec3 w;
-		shared_ptr<material> mat;
+		const material* mat;
 		aabb bbox;
 		vec3 normal;
-		double D;
-		double area;
+		real D;
+		real area;
+
+		//Distance to the plane inside ray_t and the planar coordinates (alpha, beta) of the hit point
+		bool plane_hit(const ray& r, interval ray_t, real& t, real& alpha, real& beta) const {
+			auto denom = dot(normal, r.direction());
+
+			//Parallel
+			if (std::fabs(denom) < 1e-8)
+				return false;
+
+			//Outside interval
+			t = (D - dot(normal, r.origin())) / denom;
+			if (!ray_t.contains(t))
+				return false;
+
+			//Check within planar shape
+			auto intersect = r.at(t);
+			vec3 planar_hitpt_vector = intersect - Q;
+			alpha = dot(w, cross(planar_hitpt_vector, v));
+			beta = dot(w, cross(u, planar_hitpt_vector));
+			return true;
+		}
 };
 
-inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat) {
-	auto sides = make_shared<hittable_list>();
+//The six sides of the box with opposite vertices a and b, each built by make_side(Q, u, v).
+//box() in box.h builds the same box as one oriented_box
 
+template <typename MakeSide>
+inline void box_sides(const point3& a, const point3& b, hittable_list& sides, MakeSide&& make_side) {
 	auto min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
 	auto max = point3(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
 
@@ -102,14 +125,12 @@ inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_pt
 	auto dy = vec3(0, max.y() - min.y(), 0);
 	auto dz = vec3(0, 0, max.z() - min.z());
 
-	sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat)); // front
-	sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat)); // right
-	sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat)); // back
-	sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat)); // left
-	sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat)); // top
-	sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat)); // bottom
-
-	return sides;
+	sides.add(make_side(point3(min.x(), min.y(), max.z()), dx, dy)); // front
+	sides.add(make_side(point3(max.x(), min.y(), max.z()), -dz, dy)); // right
+	sides.add(make_side(point3(max.x(), min.y(), min.z()), -dx, dy)); // back
+	sides.add(make_side(point3(min.x(), min.y(), min.z()), dz, dy)); // left
+	sides.add(make_side(point3(min.x(), max.y(), max.z()), dx, -dz)); // top
+	sides.add(make_side(point3(min.x(), min.y(), min.z()), dx, dz)); // bottom
 }
 
 #endif
\ No newline at end of file
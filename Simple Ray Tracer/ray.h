@@ -3,28 +3,36 @@
 
 #include "vec3.h"
 
+#include <limits>
+
 //Ray (Vector) = P(t) = A + t*b
 
 class ray {
 	public:
 		ray() {}
 
-		ray(const point3& origin, const vec3& direction, double time) : orig(origin), dir(direction), tm(time) {}
+		ray(const point3& origin, const vec3& direction, real time) : orig(origin), dir(direction), tm(time) {}
 
 		ray(const point3& origin, const vec3& direction) : ray(origin, direction, 0) {}
 
 		const point3& origin() const { return orig; }
 		const vec3& direction() const { return dir; }
-		const double& time() const { return tm; }
+		const real& time() const { return tm; }
 
-		point3 at(double s) const { // s -> scalar value
+		point3 at(real s) const { // s -> scalar value
 			return orig + s * dir;
 		}
 	
 	private:
 		point3 orig; //A
 		vec3 dir; //b
-		double tm; //Time for motion blur
+		real tm; //Time for motion blur
 };
 
+//Bound on the rounding error, along any axis, of a hit point p = r.at(t) relative to
+//the surface it was computed for: a few ulps of the magnitudes the computation went through
+inline real hit_point_error(const ray& r, const point3& p) {
+	return 8 * std::numeric_limits<real>::epsilon() * (max_abs(r.origin()) + max_abs(p));
+}
+
 #endif
\ No newline at end of file
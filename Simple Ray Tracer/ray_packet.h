@@ -0,0 +1,89 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.h"
+#include "utility.h"
+
+#include <cstdint>
+
+/* Ray Packet
+*
+* N coherent rays traced together. Box tests read the SoA origin/reciprocal direction
+* arrays and run over all N lanes at once. Primitive tests take the AoS copies. A lane
+* takes part only while its bit is set in the active mask. Lanes drop out when they miss
+* a box (interval culling) or, for occlusion, once they are blocked.
+*/
+template <int N>
+class ray_packet {
+	static_assert(N == 4 || N == 8 || N == 16, "ray_packet supports 4, 8 or 16 rays");
+
+	public:
+		static constexpr int size = N;
+
+		alignas(32) double origin[3][N];
+		alignas(32) double inv_dir[3][N];
+		alignas(32) double t_min[N];
+		alignas(32) double t_max[N];
+		ray rays[N];
+		std::uint32_t active = 0;
+
+		ray_packet() {
+			for (int i = 0; i < N; i++) {
+				for (int axis = 0; axis < 3; axis++) {
+					origin[axis][i] = 0;
+					inv_dir[axis][i] = infinity;
+				}
+				t_min[i] = 0;
+				t_max[i] = -infinity; //Inactive lanes never overlap a box
+			}
+		}
+
+		void set(int lane, const ray& r, interval ray_t) {
+			rays[lane] = r;
+			for (int axis = 0; axis < 3; axis++) {
+				origin[axis][lane] = r.origin()[axis];
+				inv_dir[axis][lane] = 1.0 / r.direction()[axis];
+			}
+			t_min[lane] = ray_t.min;
+			t_max[lane] = ray_t.max;
+			active |= 1u << lane;
+		}
+
+		//First active lane, its direction signs order the packet's traversal
+		int leader() const {
+			for (int i = 0; i < N; i++)
+				if (active & (1u << i))
+					return i;
+			return 0;
+		}
+
+		//Mask of lanes in mask whose [t_min, t_max] overlaps the box, lane loops innermost so they vectorise
+		std::uint32_t slab_test(const float* box_min, const float* box_max, std::uint32_t mask) const {
+			alignas(32) double lo[N];
+			alignas(32) double hi[N];
+			for (int i = 0; i < N; i++) {
+				lo[i] = t_min[i];
+				hi[i] = t_max[i];
+			}
+
+			for (int axis = 0; axis < 3; axis++) {
+				const double slab_min = box_min[axis];
+				const double slab_max = box_max[axis];
+				for (int i = 0; i < N; i++) {
+					auto t0 = (slab_min - origin[axis][i]) * inv_dir[axis][i];
+					auto t1 = (slab_max - origin[axis][i]) * inv_dir[axis][i];
+					auto near = inv_dir[axis][i] < 0 ? t1 : t0;
+					auto far = inv_dir[axis][i] < 0 ? t0 : t1;
+					lo[i] = near > lo[i] ? near : lo[i];
+					hi[i] = far < hi[i] ? far : hi[i];
+				}
+			}
+
+			std::uint32_t hits = 0;
+			for (int i = 0; i < N; i++)
+				hits |= std::uint32_t(lo[i] <= hi[i]) << i;
+			return hits & mask;
+		}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/* xoshiro256** Generator (Blackman & Vigna)
+*
+* 256 bits of state, period 2^256 - 1, a handful of shifts/rotates per output and
+* no shared state, so every thread owns one and draws without locking.
+* State is expanded from a 64-bit seed with splitmix64 as the authors recommend.
+*/
+class rng {
+	public:
+		rng() : rng(0) {}
+		rng(std::uint64_t seed) { reseed(seed); }
+
+		void reseed(std::uint64_t seed) {
+			for (auto& word : state)
+				word = splitmix64(seed);
+		}
+
+		std::uint64_t next() {
+			auto result = rotl(state[1] * 5, 7) * 9;
+			auto t = state[1] << 17;
+
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= t;
+			state[3] = rotl(state[3], 45);
+
+			return result;
+		}
+
+		//Uniform in [0, 1) using the top 53 bits
+		double next_double() {
+			return (next() >> 11) * 0x1.0p-53;
+		}
+
+		static std::uint64_t splitmix64(std::uint64_t& x) {
+			auto z = (x += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		}
+
+	private:
+		std::uint64_t state[4];
+
+		static std::uint64_t rotl(std::uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+};
+
+//Generator owned by the calling thread
+inline rng& thread_rng() {
+	static thread_local rng generator;
+	return generator;
+}
+
+//Seeds the calling thread's generator from (seed, pixel, sample) so a sample draws the same
+//numbers whichever thread or tile renders it
+inline void seed_thread_rng(std::uint64_t seed, std::uint64_t pixel_index, std::uint64_t sample_index) {
+	auto key = seed;
+	key = rng::splitmix64(key) ^ pixel_index;
+	key = rng::splitmix64(key) ^ sample_index;
+	thread_rng().reseed(key);
+}
+
+#endif
\ No newline at end of file
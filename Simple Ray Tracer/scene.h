@@ -0,0 +1,200 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "box.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "quad.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//Hittables that only group or transform others, every other hittable counts as a primitive
+template <typename T>
+constexpr bool is_primitive_hittable = std::is_base_of_v<hittable, T>
+	&& !std::is_base_of_v<hittable_list, T>
+	&& !std::is_base_of_v<bvh_node, T>
+	&& !std::is_base_of_v<transform, T>;
+
+/* Scene
+*
+* Owns every object built through make<T>(). Each type gets its own arena of
+* blocks that objects are bump-allocated from, so all quads sit next to each
+* other, all spheres next to each other and so on, with no control blocks in
+* between. make() returns a non-owning shared_ptr (aliasing an empty owner), so
+* the existing shared_ptr interfaces keep working and copying one never touches
+* a reference count. Everything is destroyed and freed in one go with the scene,
+* which therefore has to outlive every render of it. Construction is single-threaded.
+*/
+class scene {
+	public:
+		scene() {}
+		scene(const scene&) = delete;
+		scene& operator=(const scene&) = delete;
+
+		//Reverse order of construction, arena by arena
+		~scene() {
+			while (!arenas.empty())
+				arenas.pop_back();
+		}
+
+		template <typename T, typename... Args>
+		shared_ptr<T> make(Args&&... args) {
+			T* object = arena<T>().create(std::forward<Args>(args)...);
+			return shared_ptr<T>(shared_ptr<void>(), object);
+		}
+
+		//Materials live in the arenas too, primitives and hit records refer to them by the returned handle
+		template <typename T, typename... Args>
+		const T* add_material(Args&&... args) {
+			return make<T>(std::forward<Args>(args)...).get();
+		}
+
+		size_t bytes_used() const {
+			size_t total = 0;
+			for (const auto& a : arenas)
+				total += a->bytes_used();
+			return total;
+		}
+
+		size_t bytes_reserved() const {
+			size_t total = 0;
+			for (const auto& a : arenas)
+				total += a->bytes_reserved();
+			return total;
+		}
+
+		size_t primitive_count() const {
+			size_t total = 0;
+			for (const auto& a : arenas)
+				total += a->primitive ? a->size() : 0;
+			return total;
+		}
+
+		//One line per type, then arena bytes per primitive (hittable_list storage is not included)
+		void report_memory(std::ostream& out) const {
+			for (const auto& a : arenas) {
+				out << "  " << a->name << ": " << a->size() << " x " << a->object_size << " B = "
+					<< a->bytes_used() << " B (" << a->bytes_reserved() << " B reserved)\n";
+			}
+
+			auto primitives = primitive_count();
+			out << "Scene: " << bytes_used() << " B used, " << bytes_reserved() << " B reserved, " << primitives << " primitives";
+			if (primitives > 0)
+				out << ", " << double(bytes_used()) / primitives << " B used (" << double(bytes_reserved()) / primitives << " B reserved) per primitive";
+			out << '\n';
+		}
+
+	private:
+		class arena_base {
+			public:
+				std::string name;
+				size_t object_size;
+				bool primitive;
+
+				arena_base(std::string name, size_t object_size, bool primitive)
+					: name(std::move(name)), object_size(object_size), primitive(primitive) {}
+				virtual ~arena_base() = default;
+
+				virtual size_t size() const = 0;
+				virtual size_t bytes_reserved() const = 0;
+				size_t bytes_used() const { return size() * object_size; }
+		};
+
+		//Bump allocator over blocks of T, each block twice the previous up to max_block objects
+		template <typename T>
+		class typed_arena : public arena_base {
+			public:
+				typed_arena() : arena_base(readable_name(typeid(T).name()), sizeof(T), is_primitive_hittable<T>) {}
+
+				~typed_arena() {
+					for (auto b = blocks.rbegin(); b != blocks.rend(); ++b) {
+						for (size_t i = b->used; i > 0; i--)
+							b->objects[i - 1].~T();
+						::operator delete(static_cast<void*>(b->objects), std::align_val_t(alignof(T)));
+					}
+				}
+
+				template <typename... Args>
+				T* create(Args&&... args) {
+					if (blocks.empty() || blocks.back().used == blocks.back().capacity) {
+						auto capacity = blocks.empty() ? first_block : std::min(blocks.back().capacity * 2, max_block);
+						auto memory = ::operator new(capacity * sizeof(T), std::align_val_t(alignof(T)));
+						blocks.push_back({ static_cast<T*>(memory), 0, capacity });
+					}
+
+					auto& b = blocks.back();
+					T* object = new (&b.objects[b.used]) T(std::forward<Args>(args)...);
+					b.used++;
+					count++;
+					return object;
+				}
+
+				size_t size() const override { return count; }
+
+				size_t bytes_reserved() const override {
+					size_t total = 0;
+					for (const auto& b : blocks)
+						total += b.capacity * sizeof(T);
+					return total;
+				}
+
+			private:
+				static constexpr size_t first_block = 8;
+				static constexpr size_t max_block = 4096;
+
+				struct block {
+					T* objects;
+					size_t used;
+					size_t capacity;
+				};
+
+				std::vector<block> blocks;
+				size_t count = 0;
+		};
+
+		std::vector<std::unique_ptr<arena_base>> arenas;
+		std::unordered_map<std::type_index, arena_base*> by_type;
+
+		template <typename T>
+		typed_arena<T>& arena() {
+			auto found = by_type.find(typeid(T));
+			if (found != by_type.end())
+				return *static_cast<typed_arena<T>*>(found->second);
+
+			arenas.push_back(std::make_unique<typed_arena<T>>());
+			by_type[typeid(T)] = arenas.back().get();
+			return *static_cast<typed_arena<T>*>(arenas.back().get());
+		}
+
+		//"4quad" (Itanium) or "class quad" (MSVC) -> "quad"
+		static std::string readable_name(const char* name) {
+			if (std::strncmp(name, "class ", 6) == 0)
+				return name + 6;
+			if (std::strncmp(name, "struct ", 7) == 0)
+				return name + 7;
+			while (std::isdigit(static_cast<unsigned char>(*name)))
+				name++;
+			return name;
+		}
+};
+
+//box() allocated in the scene
+inline shared_ptr<oriented_box> box(scene& owner, const point3& a, const point3& b, const material* mat) {
+	return owner.make<oriented_box>(a, b, mat);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//Instruction set detection shared by the SIMD kernels
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SRT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//GCC and Clang only emit AVX2 instructions inside functions marked for it, MSVC always can
+#if defined(SRT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SRT_TARGET_SSE __attribute__((target("sse2")))
+#define SRT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SRT_TARGET_AVX2_NO_FMA __attribute__((target("avx2"))) //No mul + add contraction, rounds like the scalar code
+#else
+#define SRT_TARGET_SSE
+#define SRT_TARGET_AVX2
+#define SRT_TARGET_AVX2_NO_FMA
+#endif
+
+enum class simd_isa {
+	scalar,
+	sse,  //SSE2, 4 floats / 2 doubles per register
+	avx2  //AVX2 + FMA, 8 floats / 4 doubles per register
+};
+
+inline const char* simd_isa_name(simd_isa isa) {
+	switch (isa) {
+		case simd_isa::avx2: return "avx2";
+		case simd_isa::sse: return "sse";
+		default: return "scalar";
+	}
+}
+
+//Best instruction set the running CPU (and OS) supports, queried once via CPUID
+inline simd_isa detect_simd_isa() {
+	static const simd_isa detected = []() {
+#if defined(SRT_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return simd_isa::avx2;
+		return __builtin_cpu_supports("sse2") ? simd_isa::sse : simd_isa::scalar;
+#elif defined(SRT_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		if (avx2 && fma && os_saves_ymm)
+			return simd_isa::avx2;
+		return sse2 ? simd_isa::sse : simd_isa::scalar;
+#else
+		return simd_isa::scalar;
+#endif
+	}();
+	return detected;
+}
+
+//Clamps a requested instruction set to what the CPU supports
+inline simd_isa supported_simd_isa(simd_isa requested) {
+	auto available = detect_simd_isa();
+	return int(requested) <= int(available) ? requested : available;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+#ifndef SOA_BVH_H
+#define SOA_BVH_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "bvh_builder.h"
+#include "flat_bvh.h"
+#include "flat_bvh_node.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "primitive_soa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+//(type, range) of one leaf run, indices are into that type's arrays
+struct primitive_run {
+	std::uint32_t first;
+	std::uint16_t count;
+	primitive_type type;
+};
+
+/* Data-Oriented BVH
+*
+* Same node layout and traversal as flat_bvh, but leaves hold up to max_leaf_size
+* primitives as runs of one type. Spheres and quads are copied into per-type SoA
+* arrays (primitive_soa.h) and each run is intersected with one tight non-virtual
+* loop. Any other hittable (transforms, media, lists, user types) goes into a custom
+* run and is called through hittable::hit, so the interface still works as an adapter.
+* Only exact sphere and quad types are copied, subclasses stay custom. Sphere and
+* quad runs use the widest SIMD distance kernel of isa the CPU supports.
+*/
+class soa_bvh : public hittable {
+	public:
+		//Builds the tree with bvh_builder on thread_count threads (0 -> all cores), list must not be empty
+		soa_bvh(const hittable_list& list, bvh_split split = bvh_split::sah, int max_leaf_size = 8, simd_isa isa = simd_isa::avx2, int thread_count = 0)
+			: soa_bvh(*build_bvh(list, split, thread_count), max_leaf_size, isa) {}
+
+		soa_bvh(const bvh_node& tree, int max_leaf_size = 8, simd_isa isa = simd_isa::avx2)
+			: spheres(isa), quads(isa), bbox(tree.bounding_box()),
+			max_leaf(std::clamp<std::uint32_t>(std::uint32_t(max_leaf_size), 1, max_primitive_run)) {
+			build(tree, 1);
+
+			//Same guard as flat_bvh, median splits keep the traversal stack bounded
+			if (max_depth >= max_stack) {
+				std::vector<shared_ptr<hittable>> objects;
+				collect(tree, objects);
+				*this = soa_bvh(bvh_node(objects, 0, objects.size(), bvh_split::median), int(max_leaf), isa);
+			}
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			return traverse<false>(r, ray_t, rec);
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			hit_record unused;
+			return traverse<true>(r, ray_t, unused);
+		}
+
+		aabb bounding_box() const override { return bbox; }
+
+		size_t node_count() const { return nodes.size(); }
+		size_t run_count() const { return runs.size(); }
+		size_t sphere_count() const { return spheres.size(); }
+		size_t quad_count() const { return quads.size(); }
+		size_t custom_count() const { return custom.size(); }
+		simd_isa kernel_isa() const { return spheres.kernel_isa(); }
+
+	private:
+		static constexpr int max_stack = 64;
+
+		std::vector<flat_bvh_node> nodes; //Leaf offset/count index runs instead of primitives
+		std::vector<primitive_run> runs;
+		sphere_soa spheres;
+		quad_soa quads;
+		std::vector<const hittable*> custom;
+		std::vector<shared_ptr<hittable>> owned; //Keeps custom primitives alive
+		aabb bbox;
+		std::uint32_t max_leaf;
+		int max_depth = 0;
+
+		//flat_bvh's walk, any_hit returns at the first run that blocks ray_t and leaves rec alone
+		template <bool any_hit>
+		bool traverse(const ray& r, interval ray_t, hit_record& rec) const {
+			const point3& orig = r.origin();
+			const vec3& dir = r.direction();
+			const double inv_dir[3] = { 1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2] };
+			const bool dir_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+			std::uint32_t stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+			bool hit_anything = false;
+
+			while (true) {
+				const flat_bvh_node& node = nodes[current];
+
+				if (slab_hit(node, orig, inv_dir, ray_t)) {
+					if (node.count > 0) {
+						for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+							if constexpr (any_hit) {
+								if (occluded_run(runs[i], r, ray_t))
+									return true;
+							}
+							else if (hit_run(runs[i], r, ray_t, rec)) {
+								hit_anything = true;
+								ray_t.max = rec.s;
+							}
+						}
+					}
+					else {
+						if (dir_negative[node.axis]) {
+							stack[stack_size++] = current + 1;
+							current = node.offset;
+						}
+						else {
+							stack[stack_size++] = node.offset;
+							current = current + 1;
+						}
+						continue;
+					}
+				}
+
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+
+			return hit_anything;
+		}
+
+		bool hit_run(const primitive_run& run, const ray& r, interval ray_t, hit_record& rec) const {
+			switch (run.type) {
+				case primitive_type::sphere: return spheres.hit_run(r, run.first, run.count, ray_t, rec);
+				case primitive_type::quad: return quads.hit_run(r, run.first, run.count, ray_t, rec);
+				default: break;
+			}
+
+			bool hit_anything = false;
+			for (std::uint32_t i = run.first; i < run.first + run.count; i++) {
+				if (custom[i]->hit(r, ray_t, rec)) {
+					hit_anything = true;
+					ray_t.max = rec.s;
+				}
+			}
+			return hit_anything;
+		}
+
+		//The SIMD kernels test the whole run at once anyway, any distance inside ray_t blocks it
+		bool occluded_run(const primitive_run& run, const ray& r, interval ray_t) const {
+			real t;
+			switch (run.type) {
+				case primitive_type::sphere: return spheres.nearest(r, run.first, run.count, ray_t, t) != run.count;
+				case primitive_type::quad: return quads.nearest(r, run.first, run.count, ray_t, t) != run.count;
+				default: break;
+			}
+
+			for (std::uint32_t i = run.first; i < run.first + run.count; i++)
+				if (custom[i]->occluded(r, ray_t))
+					return true;
+			return false;
+		}
+
+		//Primitives under a bvh_node, a lone object duplicated into both children counts once
+		static void collect(const bvh_node& node, std::vector<shared_ptr<hittable>>& objects) {
+			collect_child(node.left_child(), objects);
+			if (node.right_child() != node.left_child())
+				collect_child(node.right_child(), objects);
+		}
+
+		static void collect_child(const shared_ptr<hittable>& child, std::vector<shared_ptr<hittable>>& objects) {
+			if (auto node = dynamic_cast<const bvh_node*>(child.get()))
+				collect(*node, objects);
+			else
+				objects.push_back(child);
+		}
+
+		static size_t primitive_count(const shared_ptr<hittable>& object) {
+			auto node = dynamic_cast<const bvh_node*>(object.get());
+			if (!node)
+				return 1;
+			if (node->left_child() == node->right_child())
+				return primitive_count(node->left_child());
+			return primitive_count(node->left_child()) + primitive_count(node->right_child());
+		}
+
+		//Appends the subtree in depth-first order, a subtree of at most max_leaf primitives becomes one leaf
+		std::uint32_t build(const bvh_node& node, int depth) {
+			max_depth = depth > max_depth ? depth : max_depth;
+
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+			set_bounds(nodes[index], node.bounding_box());
+
+			const auto& left = node.left_child();
+			const auto& right = node.right_child();
+			if (left == right || primitive_count(left) + primitive_count(right) <= max_leaf) {
+				std::vector<shared_ptr<hittable>> objects;
+				collect(node, objects);
+				make_leaf(index, objects);
+				return index;
+			}
+
+			nodes[index].axis = std::uint8_t(split_axis(left->bounding_box(), right->bounding_box()));
+
+			build_child(left, depth + 1);
+			auto second = build_child(right, depth + 1);
+			nodes[index].offset = second;
+			return index;
+		}
+
+		std::uint32_t build_child(const shared_ptr<hittable>& child, int depth) {
+			if (auto node = dynamic_cast<const bvh_node*>(child.get()))
+				return build(*node, depth);
+
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+			set_bounds(nodes[index], child->bounding_box());
+			make_leaf(index, { child });
+			return index;
+		}
+
+		//Groups the leaf's primitives by type, one run per type present
+		void make_leaf(std::uint32_t index, const std::vector<shared_ptr<hittable>>& objects) {
+			nodes[index].offset = std::uint32_t(runs.size());
+
+			for (auto type : { primitive_type::sphere, primitive_type::quad, primitive_type::custom }) {
+				auto first = type == primitive_type::sphere ? spheres.size() : type == primitive_type::quad ? quads.size() : custom.size();
+				primitive_run run = { std::uint32_t(first), 0, type };
+
+				for (const auto& object : objects) {
+					if (type_of(*object) != type)
+						continue;
+
+					if (type == primitive_type::sphere) {
+						spheres.add(static_cast<const sphere&>(*object));
+					}
+					else if (type == primitive_type::quad) {
+						quads.add(static_cast<const quad&>(*object));
+					}
+					else {
+						custom.push_back(object.get());
+						owned.push_back(object);
+					}
+					run.count++;
+				}
+				if (run.count > 0)
+					runs.push_back(run);
+			}
+
+			nodes[index].count = std::uint16_t(runs.size() - nodes[index].offset);
+		}
+
+		static primitive_type type_of(const hittable& object) {
+			if (typeid(object) == typeid(sphere))
+				return primitive_type::sphere;
+			if (typeid(object) == typeid(quad))
+				return primitive_type::quad;
+			return primitive_type::custom;
+		}
+};
+
+#endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "onb.h"
 #include "utility.h"
 
 /* Math Breakdowns
@@ -38,14 +39,14 @@
 class sphere : public hittable {
 	public:
         //Stationary
-        sphere(const point3& static_center, double radius, shared_ptr<material> mat) : center(static_center, vec3(0, 0, 0)), radius(std::fmax(0, radius)), mat(mat)
+        sphere(const point3& static_center, double radius, const material* mat) : center(static_center, vec3(0, 0, 0)), radius(real(std::fmax(0, radius))), mat(mat)
         {
 			auto rvec = vec3(radius, radius, radius);
 			bbox = aabb(static_center - rvec, static_center + rvec);
         }
 
         //Moving
-        sphere(const point3& center1, const point3& center2, double radius, shared_ptr<material> mat) : center(center1, center2 - center1), radius(std::fmax(0, radius)), mat(mat)
+        sphere(const point3& center1, const point3& center2, double radius, const material* mat) : center(center1, center2 - center1), radius(real(std::fmax(0, radius))), mat(mat)
         {
 			auto rvec = vec3(radius, radius, radius);
 			aabb box1(center.at(0) - rvec, center.at(0) + rvec);
@@ -56,26 +57,18 @@ class sphere : public hittable {
         //Intersection Alg
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
             point3 current_center = center.at(r.time());
-            vec3 oc = current_center - r.origin();
-            auto a = r.direction().length_squared();
-            auto h = dot(r.direction(), oc);
-            auto c = oc.length_squared() - radius * radius;
-
-            auto discriminant = h * h - a * c;
-			if (discriminant < 0) // No intersection
+            real root;
+            if (!nearest_root(r, current_center, ray_t, root))
                 return false;
 
-			//Checking if root is within the interval
-            auto sqrtd = std::sqrt(discriminant);
-            auto root = (h - sqrtd) / a;
-            if (!ray_t.surrounds(root)) {
-                root = (h + sqrtd) / a;
-                if (!ray_t.surrounds(root))
-                    return false;
-            }
-
             rec.s = root;
             rec.p = r.at(rec.s);
+
+			//Project back onto the sphere, which bounds the error by the sphere's size instead of the ray's
+			vec3 from_center = rec.p - current_center;
+			rec.p = current_center + from_center * (radius / from_center.length());
+			rec.p_error = 8 * std::numeric_limits<real>::epsilon() * (max_abs(current_center) + radius);
+
 			vec3 outward_normal = (rec.p - current_center) / radius; //Unit length
 			rec.set_face_normal(r, outward_normal);
             get_sphere_uv(outward_normal, rec.u, rec.v);
@@ -84,13 +77,19 @@ class sphere : public hittable {
             return true;
         }
 
+        //Only the distance, no hit point, normal or (u, v)
+        bool occluded(const ray& r, interval ray_t) const override {
+            real root;
+            return nearest_root(r, center.at(r.time()), ray_t, root);
+        }
+
         aabb bounding_box() const override { return bbox; }
 
         double pdf_value(const point3& origin, const vec3& direction) const override {
             // This method only works for stationary spheres.
 
             hit_record rec;
-            if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+            if (!this->hit(ray(origin, direction), interval(0, infinity), rec))
                 return 0;
 
             auto dist_squared = (center.at(0) - origin).length_squared();
@@ -107,13 +106,39 @@ class sphere : public hittable {
             return uvw.transform(random_to_sphere(radius, distance_squared));
         }
 
+        double surface_area() const override { return 4 * pi * radius * radius; }
+        const material* surface_material() const override { return mat; }
+
 	private:
+		friend class sphere_soa; //Copies the geometry into SoA arrays
+
 		ray center;
-		double radius;
-		shared_ptr<material> mat;
+		real radius;
+		const material* mat;
         aabb bbox;
 
-        static void get_sphere_uv(const point3& p, double& u, double& v) {
+        bool nearest_root(const ray& r, const point3& current_center, interval ray_t, real& root) const {
+            vec3 oc = current_center - r.origin();
+            auto a = r.direction().length_squared();
+            auto h = dot(r.direction(), oc);
+            auto c = oc.length_squared() - radius * radius;
+
+            auto discriminant = h * h - a * c;
+			if (discriminant < 0) // No intersection
+                return false;
+
+			//Checking if root is within the interval
+            auto sqrtd = std::sqrt(discriminant);
+            root = (h - sqrtd) / a;
+            if (!ray_t.surrounds(root)) {
+                root = (h + sqrtd) / a;
+                if (!ray_t.surrounds(root))
+                    return false;
+            }
+            return true;
+        }
+
+        static void get_sphere_uv(const point3& p, real& u, real& v) {
             auto theta = std::acos(-p.y());
             auto phi = std::atan2(-p.z(), p.x()) + pi;
 
@@ -0,0 +1,184 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Rectangular block of pixels [x0, x1) x [y0, y1)
+struct tile {
+	int x0, y0;
+	int x1, y1;
+};
+
+inline std::vector<tile> make_tiles(int width, int height, int tile_size) {
+	std::vector<tile> tiles;
+
+	for (int y = 0; y < height; y += tile_size)
+		for (int x = 0; x < width; x += tile_size)
+			tiles.push_back({ x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) });
+
+	return tiles;
+}
+
+inline int resolve_thread_count(int requested) {
+	if (requested > 0)
+		return requested;
+
+	int hardware = int(std::thread::hardware_concurrency());
+	return hardware > 0 ? hardware : 1;
+}
+
+//Runs work(part) for part = 0 .. parts-1, one thread each, the calling thread taking part 0.
+//Futures are waited for on destruction, so an exception from any part is rethrown after all have finished
+template <typename Work>
+void run_parts(int parts, Work&& work) {
+	std::vector<std::future<void>> workers;
+	for (int part = 1; part < parts; part++)
+		workers.push_back(std::async(std::launch::async, [&work, part]() { work(part); }));
+	work(0);
+	for (auto& worker : workers)
+		worker.get();
+}
+
+/* Work-Stealing Scheduler
+*
+* Every worker owns a deque seeded with a contiguous run of tiles (neighbouring
+* tiles share cache lines of the scene). A worker pops from the back of its own
+* deque and, once that runs dry, steals from the front of the other workers' deques.
+* No work is added after start, so a worker exits after a full pass of failed steals.
+*/
+class tile_scheduler {
+	public:
+		tile_scheduler(int thread_count) : worker_count(resolve_thread_count(thread_count)) {}
+
+		int threads() const { return worker_count; }
+
+		void run(const std::vector<tile>& tiles, const std::function<void(const tile&, int)>& work) {
+			if (tiles.empty())
+				return;
+
+			queues = std::vector<work_queue>(worker_count);
+
+			size_t per_worker = (tiles.size() + worker_count - 1) / worker_count;
+			for (size_t i = 0; i < tiles.size(); i++)
+				queues[i / per_worker].tiles.push_back(tiles[i]);
+
+			std::vector<std::thread> workers;
+			for (int id = 1; id < worker_count; id++)
+				workers.emplace_back([this, &work, id]() { worker_loop(id, work); });
+
+			worker_loop(0, work); //Calling thread works too
+
+			for (auto& worker : workers)
+				worker.join();
+		}
+
+	private:
+		struct work_queue {
+			std::mutex lock;
+			std::deque<tile> tiles;
+		};
+
+		int worker_count;
+		std::vector<work_queue> queues;
+
+		void worker_loop(int id, const std::function<void(const tile&, int)>& work) {
+			tile t;
+			while (pop_local(id, t) || steal(id, t))
+				work(t, id);
+		}
+
+		bool pop_local(int id, tile& t) {
+			std::lock_guard<std::mutex> guard(queues[id].lock);
+			if (queues[id].tiles.empty())
+				return false;
+
+			t = queues[id].tiles.back();
+			queues[id].tiles.pop_back();
+			return true;
+		}
+
+		bool steal(int id, tile& t) {
+			for (int offset = 1; offset < worker_count; offset++) {
+				auto& victim = queues[(id + offset) % worker_count];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				if (victim.tiles.empty())
+					continue;
+
+				t = victim.tiles.front();
+				victim.tiles.pop_front();
+				return true;
+			}
+			return false;
+		}
+};
+
+//Thread-safe tile and ray counters, reported periodically on std::clog by a background thread
+class render_progress {
+	public:
+		render_progress(size_t total_tiles) : total_tiles(total_tiles), start(std::chrono::steady_clock::now()) {
+			reporter = std::thread([this]() { report_loop(); });
+		}
+
+		~render_progress() { finish(); }
+
+		void tile_done(std::uint64_t rays) {
+			tiles_done.fetch_add(1, std::memory_order_relaxed);
+			rays_traced.fetch_add(rays, std::memory_order_relaxed);
+		}
+
+		void finish() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (finished)
+					return;
+				finished = true;
+			}
+			wake.notify_all();
+			reporter.join();
+			print();
+			std::clog << '\n';
+		}
+
+		std::uint64_t rays() const { return rays_traced.load(); }
+
+		double seconds() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		size_t total_tiles;
+		std::atomic<size_t> tiles_done{ 0 };
+		std::atomic<std::uint64_t> rays_traced{ 0 };
+		std::chrono::steady_clock::time_point start;
+
+		std::mutex lock;
+		std::condition_variable wake;
+		bool finished = false;
+		std::thread reporter;
+
+		void report_loop() {
+			std::unique_lock<std::mutex> guard(lock);
+			while (!wake.wait_for(guard, std::chrono::milliseconds(500), [this]() { return finished; }))
+				print();
+		}
+
+		void print() const {
+			auto elapsed = seconds();
+			auto mrays_per_second = elapsed > 0 ? rays_traced.load() / elapsed / 1e6 : 0.0;
+			std::clog << "\rTiles: " << tiles_done.load() << '/' << total_tiles
+					  << "  " << mrays_per_second << " Mrays/s  " << std::flush;
+		}
+};
+
+#endif
\ No newline at end of file
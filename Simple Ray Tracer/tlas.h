@@ -0,0 +1,230 @@
+#ifndef TLAS_H
+#define TLAS_H
+
+#include "aabb.h"
+#include "affine.h"
+#include "bvh.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/* Two-Level Acceleration Structure
+*
+* The top level of instanced rendering. Every unique geometry is built once into its
+* own bottom-level structure (BLAS: any hittable, typically a flat_bvh or soa_bvh over
+* its primitives) and placed any number of times as an instance: a transform of the
+* shared BLAS plus an optional material that replaces the one its primitives carry.
+* Memory grows with the unique geometry plus one transform node per instance.
+*
+* The TLAS is a binned SAH tree over the instances' world boxes, stored flat in
+* depth-first order (children after their parent), walked nearest child first. Moving
+* an instance only touches this level: set_transform() then refit() recomputes the
+* boxes bottom-up keeping the tree, build() builds it anew once refits have let the
+* tree degrade. The BLASes are never rebuilt. Call build() before tracing.
+*/
+class tlas : public hittable {
+	public:
+		//Places geometry by to_world and returns the instance's index
+		size_t add(shared_ptr<hittable> geometry, const affine& to_world, const material* material_override = nullptr) {
+			geometries.push_back(geometry);
+			instances.emplace_back(geometry, to_world);
+			overrides.push_back(material_override);
+			return instances.size() - 1;
+		}
+
+		//Moves instance i, the tree is stale until refit() or build()
+		void set_transform(size_t i, const affine& to_world) {
+			instances[i] = transform(geometries[i], to_world);
+		}
+
+		const affine& transform_of(size_t i) const { return instances[i].matrix(); }
+
+		void build() {
+			nodes.clear();
+			order.resize(instances.size());
+			for (std::uint32_t i = 0; i < order.size(); i++)
+				order[i] = i;
+			if (!instances.empty())
+				build_node(0, order.size());
+		}
+
+		//Children follow their parent, so a reverse sweep sees both children before the node
+		void refit() {
+			for (size_t n = nodes.size(); n-- > 0;) {
+				auto& node = nodes[n];
+				if (node.count > 0) {
+					node.bbox = aabb::empty;
+					for (auto i = node.first; i < node.first + node.count; i++)
+						node.bbox = aabb(node.bbox, instances[order[i]].bounding_box());
+				}
+				else {
+					node.bbox = aabb(nodes[n + 1].bbox, nodes[node.first].bbox);
+				}
+			}
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			bool hit_anything = false;
+			walk(r, ray_t, [&](std::uint32_t i) {
+				if (!instances[i].hit(r, ray_t, rec))
+					return false;
+				if (overrides[i])
+					rec.mat = overrides[i];
+				hit_anything = true;
+				ray_t.max = rec.s;
+				return false;
+			});
+			return hit_anything;
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			return walk(r, ray_t, [&](std::uint32_t i) { return instances[i].occluded(r, ray_t); });
+		}
+
+		aabb bounding_box() const override { return nodes.empty() ? aabb::empty : nodes[0].bbox; }
+
+		size_t size() const { return instances.size(); }
+		size_t node_count() const { return nodes.size(); }
+
+		//Instances and tree, the shared geometry is counted where it is built
+		size_t memory_bytes() const {
+			return geometries.capacity() * sizeof(shared_ptr<hittable>) + instances.capacity() * sizeof(transform)
+				+ overrides.capacity() * sizeof(const material*)
+				+ order.capacity() * sizeof(std::uint32_t) + nodes.capacity() * sizeof(node);
+		}
+
+	private:
+		struct node {
+			aabb bbox;
+			std::uint32_t first; //Leaf: first entry of order, interior: index of the second child (the first follows the node)
+			std::uint16_t count; //Instances in a leaf, 0 for interior nodes
+			std::uint8_t axis;   //Interior split axis, decides which child a ray visits first
+		};
+
+		static constexpr std::uint32_t max_leaf_size = 2;
+		static constexpr int bin_count = 16;
+		static constexpr int max_stack = 64;
+
+		std::vector<shared_ptr<hittable>> geometries; //As passed to add(), instances fold a transform it carries into theirs
+		std::vector<transform> instances;
+		std::vector<const material*> overrides;
+		std::vector<std::uint32_t> order; //Leaves index contiguous ranges of this
+		std::vector<node> nodes;
+
+		/* Walk
+		*
+		* Calls visit(instance) for the instances of every leaf the ray reaches within
+		* ray_t, which refers to the caller's interval so visit can shrink it as hits come
+		* in. A visit returning true ends the walk and walk() returns true.
+		*/
+		template <typename Visit>
+		bool walk(const ray& r, const interval& ray_t, Visit&& visit) const {
+			if (nodes.empty())
+				return false;
+
+			const bool dir_negative[3] = { r.direction().x() < 0, r.direction().y() < 0, r.direction().z() < 0 };
+			std::uint32_t stack[max_stack];
+			int stack_size = 0;
+			std::uint32_t current = 0;
+
+			while (true) {
+				const node& n = nodes[current];
+				if (n.bbox.hit(r, ray_t)) {
+					if (n.count > 0) {
+						for (auto i = n.first; i < n.first + n.count; i++)
+							if (visit(order[i]))
+								return true;
+					}
+					else {
+						if (dir_negative[n.axis]) {
+							stack[stack_size++] = current + 1;
+							current = n.first;
+						}
+						else {
+							stack[stack_size++] = n.first;
+							current = current + 1;
+						}
+						continue;
+					}
+				}
+
+				if (stack_size == 0)
+					break;
+				current = stack[--stack_size];
+			}
+			return false;
+		}
+
+		std::uint32_t build_node(size_t begin, size_t end, int depth = 1) {
+			auto index = std::uint32_t(nodes.size());
+			nodes.push_back({ aabb::empty, 0, 0, 0 });
+
+			aabb bounds = aabb::empty;
+			aabb centroids = aabb::empty;
+			for (auto i = begin; i < end; i++) {
+				auto box = instances[order[i]].bounding_box();
+				bounds = aabb(bounds, box);
+				auto c = box.centroid();
+				centroids = aabb(centroids, aabb(c, c));
+			}
+			nodes[index].bbox = bounds;
+
+			if (end - begin <= max_leaf_size) {
+				nodes[index].first = std::uint32_t(begin);
+				nodes[index].count = std::uint16_t(end - begin);
+				return index;
+			}
+
+			//Deep trees fall back to median splits, which bound the depth and keep the stack small
+			int axis = centroids.longest_axis();
+			auto mid = depth < max_stack / 2 ? partition_sah(begin, end, centroids, axis) : begin;
+			if (mid == begin || mid == end) {
+				mid = begin + (end - begin) / 2;
+				std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+					return instances[a].bounding_box().centroid()[axis] < instances[b].bounding_box().centroid()[axis];
+				});
+			}
+			nodes[index].axis = std::uint8_t(axis);
+
+			build_node(begin, mid, depth + 1);
+			nodes[index].first = build_node(mid, end, depth + 1);
+			return index;
+		}
+
+		//Binned SAH as in bvh_node, over instance boxes. Returns the split point and its axis
+		size_t partition_sah(size_t begin, size_t end, const aabb& centroids, int& split_axis) {
+			int best_axis = -1, best_split = 0;
+			auto best_cost = infinity;
+
+			for (int axis = 0; axis < 3; axis++) {
+				const interval& extent = centroids.axis_interval(axis);
+				if (!(extent.size() > 0))
+					continue;
+
+				aabb bin_bounds[bin_count];
+				size_t bin_counts[bin_count] = {};
+				for (auto i = begin; i < end; i++) {
+					auto box = instances[order[i]].bounding_box();
+					int bin = sah_bin<bin_count>(box.centroid()[axis], extent);
+					bin_counts[bin]++;
+					bin_bounds[bin] = aabb(bin_bounds[bin], box);
+				}
+
+				sah_sweep(bin_bounds, bin_counts, axis, best_cost, best_axis, best_split);
+			}
+
+			if (best_axis < 0)
+				return begin;
+
+			split_axis = best_axis;
+			const interval& extent = centroids.axis_interval(best_axis);
+			auto middle = std::partition(order.begin() + begin, order.begin() + end, [&](std::uint32_t i) {
+				return sah_bin<bin_count>(instances[i].bounding_box().centroid()[best_axis], extent) < best_split;
+			});
+			return size_t(middle - order.begin());
+		}
+};
+
+#endif
\ No newline at end of file
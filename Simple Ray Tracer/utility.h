@@ -7,11 +7,21 @@
 #include <limits>
 #include <memory>
 
+#include "rng.h"
+
 //Std Usings
 
 using std::make_shared;
 using std::shared_ptr;
 
+//Scalar type of the geometry kernel (vectors, rays, intervals, hit records), float when
+//built with SRT_FLOAT_PRECISION. Accumulation and random numbers stay double either way.
+#ifdef SRT_FLOAT_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 //Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -23,8 +33,9 @@ inline double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
 }
 
+//Draws from the calling thread's generator (see rng.h)
 inline double random_double() {
-	return std::rand() / (RAND_MAX + 1.0);
+	return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -2,110 +2,146 @@
 #define VEC3_H
 
 #include "utility.h"
-
-class vec3 {
+#include "simd.h"
+
+#include <type_traits>
+
+//Optional SIMD storage and operators for vec3 (CMake option SRT_SIMD_VEC3), see vec3_simd.h
+#if defined(SRT_SIMD_VEC3) && defined(SRT_X86) && (defined(__SSE2__) || defined(_M_X64))
+#define SRT_VEC3_LANES 4
+#else
+#define SRT_VEC3_LANES 3
+#endif
+
+/* 3D Vector
+*
+* Templated on the scalar type so the whole kernel can be built in float or double,
+* vec3 is the instantiation for the build's real (see utility.h). Scalar arguments
+* are not deduced, so 2 * v or v / 3.0 work for either precision. With SRT_SIMD_VEC3
+* the elements are padded to 4 aligned lanes (the 4th kept at 0) and vec3_simd.h
+* overloads the operators for vec3 with SSE/AVX code, the API stays the same.
+*/
+template <typename T>
+class vec3_t {
 	public:
-		double elements[3];
+		using scalar = std::type_identity_t<T>;
+
+		alignas(SRT_VEC3_LANES == 4 ? 4 * sizeof(T) : alignof(T)) T elements[SRT_VEC3_LANES];
 
-		vec3() : elements{ 0, 0, 0 } {}
-		vec3(double x, double y, double z) : elements{ x, y, z } {}
+		vec3_t() : elements{ 0, 0, 0 } {}
+		vec3_t(scalar x, scalar y, scalar z) : elements{ x, y, z } {}
 
-		double x() const { return elements[0]; }
-		double y() const { return elements[1]; }
-		double z() const { return elements[2]; }
+		T x() const { return elements[0]; }
+		T y() const { return elements[1]; }
+		T z() const { return elements[2]; }
 
-		//Operator Overloading
-		vec3 operator-() const { return vec3(-elements[0], -elements[1], -elements[2]); }
-		double operator[](int i) const { return elements[i]; }
-		double& operator[](int i) { return elements[i]; }
+		//Operator Overloading, through the free operators below so the SIMD overloads apply
+		vec3_t operator-() const { return scalar(-1) * *this; }
+		T operator[](int i) const { return elements[i]; }
+		T& operator[](int i) { return elements[i]; }
 
-		vec3& operator+=(const vec3& v) {
-			elements[0] += v.elements[0];
-			elements[1] += v.elements[1];
-			elements[2] += v.elements[2];
-			return *this;
+		vec3_t& operator+=(const vec3_t& v) {
+			return *this = *this + v;
 		}
 
-		vec3& operator*=(double s) {
-			elements[0] *= s;
-			elements[1] *= s;
-			elements[2] *= s;
-			return *this;
+		vec3_t& operator*=(scalar s) {
+			return *this = s * *this;
 		}
 
-		vec3& operator/=(double s) {
+		vec3_t& operator/=(scalar s) {
 			return *this *= 1/s;
 		}
 
 
-		double length() const {
+		T length() const {
 			return std::sqrt(length_squared());
 		}
 
-		double length_squared() const {
-			return elements[0] * elements[0] + elements[1] * elements[1] + elements[2] * elements[2];
+		T length_squared() const {
+			return dot(*this, *this);
 		}
 
 		bool near_zero() const {
-			auto s = 1e-8;
-			return (fabs(elements[0]) < s) && (fabs(elements[1]) < s) && (fabs(elements[2]) < s);
+			auto s = T(1e-8);
+			return (std::fabs(elements[0]) < s) && (std::fabs(elements[1]) < s) && (std::fabs(elements[2]) < s);
 		}
 
-		static vec3 random() {
-			return vec3(random_double(), random_double(), random_double());
+		static vec3_t random() {
+			return vec3_t(T(random_double()), T(random_double()), T(random_double()));
 		}
 
-		static vec3 random(double min, double max) {
-			return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+		static vec3_t random(double min, double max) {
+			return vec3_t(T(random_double(min, max)), T(random_double(min, max)), T(random_double(min, max)));
 		}
 };
 
+using vec3 = vec3_t<real>;
 using point3 = vec3; //Alias to represent point as vec
 
 //Vec Utilitiy Funcitons
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3_t<T>& v) {
 	return out << v.elements[0] << ' ' << v.elements[1] << ' ' << v.elements[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-	return vec3(u.elements[0] + v.elements[0], u.elements[1] + v.elements[1], u.elements[2] + v.elements[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.elements[0] + v.elements[0], u.elements[1] + v.elements[1], u.elements[2] + v.elements[2]);
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-	return vec3(u.elements[0] - v.elements[0], u.elements[1] - v.elements[1], u.elements[2] - v.elements[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.elements[0] - v.elements[0], u.elements[1] - v.elements[1], u.elements[2] - v.elements[2]);
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-	return vec3(u.elements[0] * v.elements[0], u.elements[1] * v.elements[1], u.elements[2] * v.elements[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.elements[0] * v.elements[0], u.elements[1] * v.elements[1], u.elements[2] * v.elements[2]);
 }
 
-inline vec3 operator*(double s, const vec3& v) {
-	return vec3(s * v.elements[0], s * v.elements[1], s * v.elements[2]);
+template <typename T>
+inline vec3_t<T> operator*(std::type_identity_t<T> s, const vec3_t<T>& v) {
+	return vec3_t<T>(s * v.elements[0], s * v.elements[1], s * v.elements[2]);
 }
 
-inline vec3 operator*(const vec3& v, double s) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& v, std::type_identity_t<T> s) {
 	return s * v;
 }
 
-inline vec3 operator/(const vec3& v, double s) {
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T>& v, std::type_identity_t<T> s) {
 	return (1 / s) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v) {
 	return u.elements[0] * v.elements[0] + u.elements[1] * v.elements[1] + u.elements[2] * v.elements[2];
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-	return vec3(u.elements[1] * v.elements[2] - u.elements[2] * v.elements[1],
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v) {
+	return vec3_t<T>(u.elements[1] * v.elements[2] - u.elements[2] * v.elements[1],
 				 u.elements[2] * v.elements[0] - u.elements[0] * v.elements[2],
 				 u.elements[0] * v.elements[1] - u.elements[1] * v.elements[0]);
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline vec3_t<T> unit_vector(const vec3_t<T>& v) {
 	return v / v.length();
 }
 
+//Largest coordinate magnitude (max norm)
+template <typename T>
+inline T max_abs(const vec3_t<T>& v) {
+	return std::fmax(std::fabs(v.elements[0]), std::fmax(std::fabs(v.elements[1]), std::fabs(v.elements[2])));
+}
+
+#if SRT_VEC3_LANES == 4
+#include "vec3_simd.h"
+#endif
+
 inline vec3 random_in_unit_disk() {
 	while (true) {
 		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
@@ -0,0 +1,142 @@
+#ifndef VEC3_SIMD_H
+#define VEC3_SIMD_H
+
+#include "vec3.h"
+
+/* SIMD vec3
+*
+* Included by vec3.h when built with SRT_SIMD_VEC3 on x86. vec3 then stores x, y, z and
+* a zero pad lane, aligned so one vector is one register: __m128 for float, __m256d for
+* double when the compiler targets AVX2 (-mavx2 / -march=native), else two __m128d.
+* The non-template overloads below take precedence over the generic templates in vec3.h.
+* Every operation uses the same operations in the same order as the scalar code (dot
+* sums (x + y) + z, a / s multiplies by 1 / s), so both builds render identical images.
+*/
+
+#if defined(SRT_FLOAT_PRECISION)
+
+struct vec3_lanes {
+	using reg = __m128;
+
+	static reg load(const vec3& v) { return _mm_load_ps(v.elements); }
+	static vec3 store(reg r) {
+		vec3 v;
+		_mm_store_ps(v.elements, r);
+		return v;
+	}
+
+	static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+	static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+	static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+	static reg splat(real s) { return _mm_set_ps(0, s, s, s); }
+
+	//(y, z, x) and (z, x, y) for cross products
+	static reg yzx(reg a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+	static reg zxy(reg a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)); }
+
+	//(x + y) + z
+	static real sum3(reg a) {
+		reg xy = _mm_add_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+		return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(a, a)));
+	}
+};
+
+#elif defined(__AVX2__)
+
+struct vec3_lanes {
+	using reg = __m256d;
+
+	static reg load(const vec3& v) { return _mm256_load_pd(v.elements); }
+	static vec3 store(reg r) {
+		vec3 v;
+		_mm256_store_pd(v.elements, r);
+		return v;
+	}
+
+	static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+	static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+	static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+	static reg splat(real s) { return _mm256_set_pd(0, s, s, s); }
+
+	static reg yzx(reg a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 0, 2, 1)); }
+	static reg zxy(reg a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 1, 0, 2)); }
+
+	static real sum3(reg a) {
+		__m128d lo = _mm256_castpd256_pd128(a);
+		__m128d xy = _mm_add_sd(lo, _mm_unpackhi_pd(lo, lo));
+		return _mm_cvtsd_f64(_mm_add_sd(xy, _mm256_extractf128_pd(a, 1)));
+	}
+};
+
+#else
+
+//SSE2 only: (x, y) and (z, pad) halves
+struct vec3_lanes {
+	struct reg {
+		__m128d xy, zw;
+	};
+
+	static reg load(const vec3& v) { return { _mm_load_pd(v.elements), _mm_load_pd(v.elements + 2) }; }
+	static vec3 store(reg r) {
+		vec3 v;
+		_mm_store_pd(v.elements, r.xy);
+		_mm_store_pd(v.elements + 2, r.zw);
+		return v;
+	}
+
+	static reg add(reg a, reg b) { return { _mm_add_pd(a.xy, b.xy), _mm_add_pd(a.zw, b.zw) }; }
+	static reg sub(reg a, reg b) { return { _mm_sub_pd(a.xy, b.xy), _mm_sub_pd(a.zw, b.zw) }; }
+	static reg mul(reg a, reg b) { return { _mm_mul_pd(a.xy, b.xy), _mm_mul_pd(a.zw, b.zw) }; }
+	static reg splat(real s) { return { _mm_set1_pd(s), _mm_set_sd(s) }; }
+
+	static reg yzx(reg a) { return { _mm_shuffle_pd(a.xy, a.zw, 1), _mm_shuffle_pd(a.xy, a.zw, 2) }; }
+	static reg zxy(reg a) { return { _mm_shuffle_pd(a.zw, a.xy, 0), _mm_shuffle_pd(a.xy, a.zw, 3) }; }
+
+	static real sum3(reg a) {
+		__m128d xy = _mm_add_sd(a.xy, _mm_unpackhi_pd(a.xy, a.xy));
+		return _mm_cvtsd_f64(_mm_add_sd(xy, a.zw));
+	}
+};
+
+#endif
+
+inline vec3 operator+(const vec3& u, const vec3& v) {
+	return vec3_lanes::store(vec3_lanes::add(vec3_lanes::load(u), vec3_lanes::load(v)));
+}
+
+inline vec3 operator-(const vec3& u, const vec3& v) {
+	return vec3_lanes::store(vec3_lanes::sub(vec3_lanes::load(u), vec3_lanes::load(v)));
+}
+
+inline vec3 operator*(const vec3& u, const vec3& v) {
+	return vec3_lanes::store(vec3_lanes::mul(vec3_lanes::load(u), vec3_lanes::load(v)));
+}
+
+inline vec3 operator*(real s, const vec3& v) {
+	return vec3_lanes::store(vec3_lanes::mul(vec3_lanes::splat(s), vec3_lanes::load(v)));
+}
+
+inline vec3 operator*(const vec3& v, real s) {
+	return s * v;
+}
+
+inline vec3 operator/(const vec3& v, real s) {
+	return (1 / s) * v;
+}
+
+inline real dot(const vec3& u, const vec3& v) {
+	return vec3_lanes::sum3(vec3_lanes::mul(vec3_lanes::load(u), vec3_lanes::load(v)));
+}
+
+inline vec3 cross(const vec3& u, const vec3& v) {
+	auto a = vec3_lanes::load(u);
+	auto b = vec3_lanes::load(v);
+	return vec3_lanes::store(vec3_lanes::sub(vec3_lanes::mul(vec3_lanes::yzx(a), vec3_lanes::zxy(b)),
+		vec3_lanes::mul(vec3_lanes::zxy(a), vec3_lanes::yzx(b))));
+}
+
+inline vec3 unit_vector(const vec3& v) {
+	return v / v.length();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,350 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "bvh_builder.h"
+#include "flat_bvh_node.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "simd.h"
+
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+//Bounds of W children in SoA form, so one SIMD slab test covers all of them
+template <int W>
+struct alignas(32) wide_bvh_node {
+	float bounds[6][W];         //min x/y/z then max x/y/z
+	std::uint32_t child[W];     //Interior: node index, Leaf: first primitive index
+	std::uint16_t count[W];     //Leaf primitive count, 0 for interior children
+	std::uint8_t used;          //Slots [0, used) hold children, the rest are masked off after the slab test
+};
+
+//Ray in the form the slab kernels consume
+struct wide_ray {
+	float origin[3];
+	float inv_dir[3];
+	float pad[3]; //|origin - float(origin)| * |inv_dir| rounded up, widens each slab by the origin's rounding
+};
+
+/* Wide BVH (BVH4 / BVH8)
+*
+* Collapses a binary bvh_node into nodes of W children by repeatedly opening the
+* largest interior child. A node visit tests all W child boxes at once with an SSE
+* (4 lanes) or AVX2 (8 lanes) slab kernel, picked at construction from CPUID, with a
+* scalar fallback. Hit children are visited nearest first and skipped once the
+* closest hit is nearer than their entry distance. Child boxes are rounded outwards
+* and each slab is widened by the rounding of the ray origin to float, so the float
+* test never rejects a box the ray hits.
+*/
+template <int W>
+class wide_bvh : public hittable {
+	static_assert(W == 4 || W == 8, "wide_bvh supports 4 or 8 children per node");
+
+	public:
+		//Builds the binary tree with bvh_builder on thread_count threads (0 -> all cores), list must not be empty
+		wide_bvh(const hittable_list& list, simd_isa isa = simd_isa::avx2, int thread_count = 0)
+			: wide_bvh(*build_bvh(list, bvh_split::sah, thread_count), isa) {}
+
+		wide_bvh(const bvh_node& tree, simd_isa isa = simd_isa::avx2) : bbox(tree.bounding_box()) {
+			select_kernel(supported_simd_isa(isa));
+			build(tree, 1);
+
+			//Keeps the fixed traversal stack large enough, median splits bound the depth
+			if (max_depth > max_levels) {
+				auto objects = owned;
+				nodes.clear();
+				owned.clear();
+				primitives.clear();
+				max_depth = 0;
+				build(bvh_node(objects, 0, objects.size(), bvh_split::median), 1);
+			}
+		}
+
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+			return traverse<false>(r, ray_t, rec);
+		}
+
+		bool occluded(const ray& r, interval ray_t) const override {
+			hit_record unused;
+			return traverse<true>(r, ray_t, unused);
+		}
+
+		aabb bounding_box() const override { return bbox; }
+
+		size_t node_count() const { return nodes.size(); }
+		simd_isa kernel_isa() const { return isa_used; }
+
+	private:
+		using kernel_fn = int (*)(const wide_bvh_node<W>&, const wide_ray&, float, float, float*);
+
+		static constexpr int max_levels = 64;
+
+		//Float slab distances, padded for the origin, may be slightly short, 1 + 2 * gamma(4) keeps the test conservative
+		static constexpr float far_scale = 1.0f + 2 * (4 * 0x1.0p-24f) / (1 - 4 * 0x1.0p-24f);
+
+		std::vector<wide_bvh_node<W>> nodes;
+		std::vector<const hittable*> primitives;
+		std::vector<shared_ptr<hittable>> owned;
+		aabb bbox;
+		int max_depth = 0;
+		kernel_fn kernel;
+		simd_isa isa_used;
+
+		//any_hit returns at the first primitive that blocks ray_t and leaves rec alone
+		template <bool any_hit>
+		bool traverse(const ray& r, interval ray_t, hit_record& rec) const {
+			wide_ray wr;
+			for (int axis = 0; axis < 3; axis++) {
+				double origin = r.origin()[axis];
+				double inv_dir = 1.0 / r.direction()[axis];
+				wr.origin[axis] = float(origin);
+				wr.inv_dir[axis] = float(inv_dir);
+
+				//The kernels measure from the rounded origin, a ray with a far-off origin would otherwise miss boxes it hits
+				double origin_error = std::fabs(origin - double(wr.origin[axis]));
+				wr.pad[axis] = origin_error > 0 ? round_up(origin_error * std::fabs(inv_dir)) : 0.0f;
+			}
+			float t_min = round_down(ray_t.min);
+
+			struct entry {
+				std::uint32_t child;
+				std::uint16_t count;
+				float t_near;
+			};
+
+			entry stack[max_levels * (W - 1) + 1];
+			int stack_size = 0;
+			stack[stack_size++] = { 0, 0, -std::numeric_limits<float>::infinity() };
+
+			alignas(32) float t_near[W];
+			bool hit_anything = false;
+
+			while (stack_size > 0) {
+				auto e = stack[--stack_size];
+				if (e.t_near > ray_t.max)
+					continue;
+
+				if (e.count > 0) {
+					for (std::uint32_t i = e.child; i < e.child + e.count; i++) {
+						if constexpr (any_hit) {
+							if (primitives[i]->occluded(r, ray_t))
+								return true;
+						}
+						else if (primitives[i]->hit(r, ray_t, rec)) {
+							hit_anything = true;
+							ray_t.max = rec.s;
+						}
+					}
+					continue;
+				}
+
+				const auto& node = nodes[e.child];
+				int mask = kernel(node, wr, t_min, round_up(ray_t.max), t_near) & ((1 << node.used) - 1);
+
+				//Push the hit children farthest first so the nearest is popped next
+				int first = stack_size;
+				for (int i = 0; i < W; i++) {
+					if (!(mask & (1 << i)))
+						continue;
+
+					entry child = { node.child[i], node.count[i], t_near[i] };
+					int j = stack_size++;
+					while (j > first && stack[j - 1].t_near < child.t_near) {
+						stack[j] = stack[j - 1];
+						j--;
+					}
+					stack[j] = child;
+				}
+			}
+
+			return hit_anything;
+		}
+
+		void select_kernel(simd_isa isa) {
+#ifdef SRT_X86
+			if constexpr (W == 8) {
+				if (isa == simd_isa::avx2) {
+					kernel = &hit_children_avx2;
+					isa_used = simd_isa::avx2;
+					return;
+				}
+			}
+			if (isa != simd_isa::scalar) {
+				kernel = &hit_children_sse;
+				isa_used = simd_isa::sse;
+				return;
+			}
+#endif
+			kernel = &hit_children_scalar;
+			isa_used = simd_isa::scalar;
+		}
+
+		//A bvh_node whose children are both primitives
+		static bool is_leaf_pair(const bvh_node* node) {
+			return !dynamic_cast<const bvh_node*>(node->left_child().get())
+				&& !dynamic_cast<const bvh_node*>(node->right_child().get());
+		}
+
+		std::uint32_t build(const bvh_node& root, int depth) {
+			max_depth = depth > max_depth ? depth : max_depth;
+
+			//Open the largest interior child until the node is full
+			std::vector<shared_ptr<hittable>> slots = { root.left_child() };
+			if (root.right_child() != root.left_child())
+				slots.push_back(root.right_child());
+
+			while (int(slots.size()) < W) {
+				int best = -1;
+				auto best_area = -1.0;
+				for (int i = 0; i < int(slots.size()); i++) {
+					auto node = dynamic_cast<const bvh_node*>(slots[i].get());
+					if (!node || is_leaf_pair(node))
+						continue;
+					auto area = node->bounding_box().surface_area();
+					if (area > best_area) {
+						best_area = area;
+						best = i;
+					}
+				}
+				if (best < 0)
+					break;
+
+				auto opened = dynamic_cast<const bvh_node*>(slots[best].get());
+				auto left = opened->left_child();
+				auto right = opened->right_child();
+				slots[best] = left;
+				if (right != left)
+					slots.push_back(right);
+			}
+
+			auto index = std::uint32_t(nodes.size());
+			nodes.emplace_back();
+			for (int i = 0; i < W; i++) {
+				for (int axis = 0; axis < 3; axis++) {
+					nodes[index].bounds[axis][i] = std::numeric_limits<float>::infinity();
+					nodes[index].bounds[axis + 3][i] = -std::numeric_limits<float>::infinity();
+				}
+				nodes[index].child[i] = 0;
+				nodes[index].count[i] = 0;
+			}
+			nodes[index].used = std::uint8_t(slots.size());
+
+			for (int i = 0; i < int(slots.size()); i++) {
+				auto box = slots[i]->bounding_box();
+				for (int axis = 0; axis < 3; axis++) {
+					nodes[index].bounds[axis][i] = round_down(box.axis_interval(axis).min);
+					nodes[index].bounds[axis + 3][i] = round_up(box.axis_interval(axis).max);
+				}
+
+				auto node = dynamic_cast<const bvh_node*>(slots[i].get());
+				if (!node) {
+					set_leaf(index, i, { slots[i] });
+				}
+				else if (is_leaf_pair(node)) {
+					if (node->left_child() == node->right_child())
+						set_leaf(index, i, { node->left_child() });
+					else
+						set_leaf(index, i, { node->left_child(), node->right_child() });
+				}
+				else {
+					auto child = build(*node, depth + 1); //May reallocate nodes, so index again afterwards
+					nodes[index].child[i] = child;
+				}
+			}
+
+			return index;
+		}
+
+		void set_leaf(std::uint32_t index, int slot, std::initializer_list<shared_ptr<hittable>> objects) {
+			nodes[index].child[slot] = std::uint32_t(primitives.size());
+			nodes[index].count[slot] = std::uint16_t(objects.size());
+			for (const auto& object : objects) {
+				primitives.push_back(object.get());
+				owned.push_back(object);
+			}
+		}
+
+		//Kernels return a bitmask of hit children and write each child's entry distance
+
+		static int hit_children_scalar(const wide_bvh_node<W>& node, const wide_ray& r, float t_min, float t_max, float* t_near) {
+			int mask = 0;
+			for (int i = 0; i < W; i++) {
+				auto lo = t_min;
+				auto hi = t_max;
+				for (int axis = 0; axis < 3; axis++) {
+					auto t0 = (node.bounds[axis][i] - r.origin[axis]) * r.inv_dir[axis];
+					auto t1 = (node.bounds[axis + 3][i] - r.origin[axis]) * r.inv_dir[axis];
+					if (t0 > t1)
+						std::swap(t0, t1);
+					t0 -= r.pad[axis];
+					t1 = (t1 + r.pad[axis]) * far_scale;
+					lo = t0 > lo ? t0 : lo;
+					hi = t1 < hi ? t1 : hi;
+				}
+				t_near[i] = lo;
+				if (lo <= hi)
+					mask |= 1 << i;
+			}
+			return mask;
+		}
+
+#ifdef SRT_X86
+		SRT_TARGET_SSE
+		static int hit_children_sse(const wide_bvh_node<W>& node, const wide_ray& r, float t_min, float t_max, float* t_near) {
+			int mask = 0;
+			const __m128 scale = _mm_set1_ps(far_scale);
+
+			for (int group = 0; group < W; group += 4) {
+				__m128 lo = _mm_set1_ps(t_min);
+				__m128 hi = _mm_set1_ps(t_max);
+
+				for (int axis = 0; axis < 3; axis++) {
+					const __m128 org = _mm_set1_ps(r.origin[axis]);
+					const __m128 inv = _mm_set1_ps(r.inv_dir[axis]);
+					const __m128 pad = _mm_set1_ps(r.pad[axis]);
+					__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&node.bounds[axis][group]), org), inv);
+					__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&node.bounds[axis + 3][group]), org), inv);
+
+					//Accumulator as second operand: min/max then ignore NaN from 0 * inf
+					lo = _mm_max_ps(_mm_sub_ps(_mm_min_ps(t0, t1), pad), lo);
+					hi = _mm_min_ps(_mm_mul_ps(_mm_add_ps(_mm_max_ps(t0, t1), pad), scale), hi);
+				}
+
+				_mm_store_ps(&t_near[group], lo);
+				mask |= _mm_movemask_ps(_mm_cmple_ps(lo, hi)) << group;
+			}
+			return mask;
+		}
+
+		SRT_TARGET_AVX2
+		static int hit_children_avx2(const wide_bvh_node<W>& node, const wide_ray& r, float t_min, float t_max, float* t_near) {
+			const __m256 scale = _mm256_set1_ps(far_scale);
+			__m256 lo = _mm256_set1_ps(t_min);
+			__m256 hi = _mm256_set1_ps(t_max);
+
+			for (int axis = 0; axis < 3; axis++) {
+				const __m256 org = _mm256_set1_ps(r.origin[axis]);
+				const __m256 inv = _mm256_set1_ps(r.inv_dir[axis]);
+				const __m256 pad = _mm256_set1_ps(r.pad[axis]);
+				__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&node.bounds[axis][0]), org), inv);
+				__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&node.bounds[axis + 3][0]), org), inv);
+
+				lo = _mm256_max_ps(_mm256_sub_ps(_mm256_min_ps(t0, t1), pad), lo);
+				hi = _mm256_min_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_max_ps(t0, t1), pad), scale), hi);
+			}
+
+			_mm256_store_ps(t_near, lo);
+			return _mm256_movemask_ps(_mm256_cmp_ps(lo, hi, _CMP_LE_OQ));
+		}
+#endif
+};
+
+using bvh4 = wide_bvh<4>;
+using bvh8 = wide_bvh<8>;
+
+#endif
\ No newline at end of file